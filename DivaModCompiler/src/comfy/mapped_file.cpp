@@ -0,0 +1,113 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "mapped_file.h"
+#include "core_string.h"
+#include <Windows.h>
+
+namespace Comfy
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	b8 MappedFile::Open(std::string_view filePath)
+	{
+		Close();
+
+		// NOTE: The read-ahead of the cache manager works best with sequential access, which is how image decoders read their input
+		HANDLE file = ::CreateFileW(UTF8::WideArg(filePath).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		fileHandle = file;
+
+		LARGE_INTEGER fileSize = {};
+		if (!::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0)
+		{
+			Close();
+			return false;
+		}
+
+		HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			Close();
+			return false;
+		}
+		mappingHandle = mapping;
+
+		viewData = static_cast<const u8*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (viewData == nullptr)
+		{
+			Close();
+			return false;
+		}
+
+		viewSize = static_cast<size_t>(fileSize.QuadPart);
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+		if (viewData != nullptr)
+			::UnmapViewOfFile(viewData);
+
+		if (mappingHandle != nullptr)
+			::CloseHandle(static_cast<HANDLE>(mappingHandle));
+
+		if (fileHandle != nullptr)
+			::CloseHandle(static_cast<HANDLE>(fileHandle));
+
+		fileHandle = nullptr;
+		mappingHandle = nullptr;
+		viewData = nullptr;
+		viewSize = 0;
+	}
+
+	void MappedFile::Prefetch() const
+	{
+		if (viewData == nullptr)
+			return;
+
+		// NOTE: Purely a hint, failing to prefetch only means the pages are read in on demand instead
+		WIN32_MEMORY_RANGE_ENTRY range = {};
+		range.VirtualAddress = const_cast<u8*>(viewData);
+		range.NumberOfBytes = viewSize;
+		::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+	}
+
+	b8 MappedFile::IsOpen() const
+	{
+		return (viewData != nullptr);
+	}
+
+	const u8* MappedFile::GetData() const
+	{
+		return viewData;
+	}
+
+	size_t MappedFile::GetSize() const
+	{
+		return viewSize;
+	}
+}
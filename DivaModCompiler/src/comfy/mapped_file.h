@@ -0,0 +1,54 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "core_types.h"
+#include <string_view>
+
+namespace Comfy
+{
+	// NOTE: Read-only memory mapping of an entire file, the view stays valid until the file is closed.
+	//		 Empty files can't be mapped and fail to open just like missing ones
+	class MappedFile : NonCopyable
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+	public:
+		b8 Open(std::string_view filePath);
+		void Close();
+
+		// NOTE: Asynchronously starts reading the entire view into memory so that it isn't paged in one fault at a time once it's first accessed
+		void Prefetch() const;
+
+		b8 IsOpen() const;
+		const u8* GetData() const;
+		size_t GetSize() const;
+
+	private:
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+		const u8* viewData = nullptr;
+		size_t viewSize = 0;
+	};
+}
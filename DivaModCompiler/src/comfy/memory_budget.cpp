@@ -0,0 +1,72 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "memory_budget.h"
+
+namespace Comfy
+{
+	MemoryBudget::MemoryBudget(u64 maxByteSize) : maxByteSize(maxByteSize)
+	{
+	}
+
+	void MemoryBudget::Reserve(u64 byteSize)
+	{
+		auto lock = std::unique_lock(mutex);
+		releaseCondition.wait(lock, [&] { return (reservedByteSize == 0) || (reservedByteSize + byteSize <= maxByteSize); });
+		reservedByteSize += byteSize;
+	}
+
+	void MemoryBudget::Release(u64 byteSize)
+	{
+		{
+			const auto lock = std::scoped_lock(mutex);
+			assert(byteSize <= reservedByteSize);
+			reservedByteSize -= byteSize;
+		}
+
+		// NOTE: Waiting requests differ in size so a smaller one might fit even if the first one to wake up doesn't
+		releaseCondition.notify_all();
+	}
+
+	u64 MemoryBudget::GetMaxByteSize() const
+	{
+		return maxByteSize;
+	}
+
+	u64 MemoryBudget::GetReservedByteSize() const
+	{
+		const auto lock = std::scoped_lock(mutex);
+		return reservedByteSize;
+	}
+
+	ScopedMemoryReservation::ScopedMemoryReservation(MemoryBudget* budget, u64 byteSize) : budget(budget), byteSize(byteSize)
+	{
+		if (budget != nullptr)
+			budget->Reserve(byteSize);
+	}
+
+	ScopedMemoryReservation::~ScopedMemoryReservation()
+	{
+		if (budget != nullptr)
+			budget->Release(byteSize);
+	}
+}
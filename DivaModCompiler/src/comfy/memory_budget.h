@@ -0,0 +1,66 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "core_types.h"
+#include <mutex>
+#include <condition_variable>
+
+namespace Comfy
+{
+	// NOTE: Limits the combined size of large temporary allocations made across multiple threads and is usually shared between multiple users.
+	//		 Callers reserve everything they are about to allocate up front in a single request, so no one ever holds part of the budget while waiting for more
+	class MemoryBudget : NonCopyable
+	{
+	public:
+		MemoryBudget(u64 maxByteSize);
+		~MemoryBudget() = default;
+
+	public:
+		// NOTE: Blocks until the requested size fits into the remaining budget.
+		//		 Requests larger than the entire budget are granted once nothing else is reserved so that they can't wait forever
+		void Reserve(u64 byteSize);
+		void Release(u64 byteSize);
+
+		u64 GetMaxByteSize() const;
+		u64 GetReservedByteSize() const;
+
+	private:
+		u64 maxByteSize;
+		u64 reservedByteSize = 0;
+
+		mutable std::mutex mutex;
+		std::condition_variable releaseCondition;
+	};
+
+	// NOTE: Reserves the given size for as long as it is in scope, does nothing without a budget
+	class ScopedMemoryReservation : NonCopyable
+	{
+	public:
+		ScopedMemoryReservation(MemoryBudget* budget, u64 byteSize);
+		~ScopedMemoryReservation();
+
+	private:
+		MemoryBudget* budget;
+		u64 byteSize;
+	};
+}
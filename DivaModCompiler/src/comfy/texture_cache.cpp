@@ -0,0 +1,315 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "texture_cache.h"
+#include "texture_util.h"
+#include <array>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace Comfy
+{
+	// NOTE: Bump whenever the file layout changes
+	static constexpr std::array<char, 4> TextureCacheFileMagic = { 'C', 'T', 'X', 'C' };
+	static constexpr u32 TextureCacheFileVersion = 1;
+
+	static constexpr u64 HashPrime0 = 0x9E3779B185EBCA87;
+	static constexpr u64 HashPrime1 = 0xC2B2AE3D27D4EB4F;
+	static constexpr u64 HashPrime2 = 0x165667B19E3779F9;
+
+	static constexpr u64 RotateLeft(u64 value, i32 shift)
+	{
+		return (value << shift) | (value >> (64 - shift));
+	}
+
+	// NOTE: Final avalanche step so that every input bit affects every output bit
+	static constexpr u64 MixBits(u64 value)
+	{
+		value ^= (value >> 33);
+		value *= 0xFF51AFD7ED558CCD;
+		value ^= (value >> 33);
+		value *= 0xC4CEB9FE1A85EC53;
+		value ^= (value >> 33);
+		return value;
+	}
+
+	static std::string KeyToFileName(const TextureCacheKey& key)
+	{
+		char buffer[48];
+		sprintf_s(buffer, "%016llx%016llx.tex", static_cast<unsigned long long>(key.High), static_cast<unsigned long long>(key.Low));
+		return buffer;
+	}
+
+	template <typename ValueType>
+	static b8 ReadValue(std::ifstream& stream, ValueType& outValue)
+	{
+		return static_cast<b8>(stream.read(reinterpret_cast<char*>(&outValue), sizeof(outValue)));
+	}
+
+	template <typename ValueType>
+	static void WriteValue(std::ofstream& stream, const ValueType& value)
+	{
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	static b8 ReadTextureFile(const std::string& path, const TextureCacheKey& key, Tex& outTexture)
+	{
+		std::ifstream stream(path, std::ios::binary);
+		if (!stream)
+			return false;
+
+		std::array<char, 4> magic;
+		u32 version;
+		TextureCacheKey fileKey;
+		u32 arrayCount;
+
+		if (!ReadValue(stream, magic) || !ReadValue(stream, version) || !ReadValue(stream, fileKey) || !ReadValue(stream, arrayCount))
+			return false;
+
+		if (magic != TextureCacheFileMagic || version != TextureCacheFileVersion || fileKey != key || arrayCount > 6)
+			return false;
+
+		outTexture.MipMapsArray.resize(arrayCount);
+		for (auto& mipMaps : outTexture.MipMapsArray)
+		{
+			u32 mipCount;
+			if (!ReadValue(stream, mipCount) || mipCount > 32)
+				return false;
+
+			mipMaps.resize(mipCount);
+			for (auto& mipMap : mipMaps)
+			{
+				if (!ReadValue(stream, mipMap.Size) || !ReadValue(stream, mipMap.Format) || !ReadValue(stream, mipMap.DataSize))
+					return false;
+
+				// NOTE: Guard against corrupted files before allocating anything
+				if (mipMap.Size.x <= 0 || mipMap.Size.y <= 0 || mipMap.DataSize != TextureFormatByteSize(mipMap.Size, mipMap.Format))
+					return false;
+
+				mipMap.Data = std::make_unique<u8[]>(mipMap.DataSize);
+				if (!stream.read(reinterpret_cast<char*>(mipMap.Data.get()), mipMap.DataSize))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	static b8 WriteTextureFile(const std::string& path, const TextureCacheKey& key, const Tex& texture)
+	{
+		std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+		if (!stream)
+			return false;
+
+		WriteValue(stream, TextureCacheFileMagic);
+		WriteValue(stream, TextureCacheFileVersion);
+		WriteValue(stream, key);
+		WriteValue(stream, static_cast<u32>(texture.MipMapsArray.size()));
+
+		for (const auto& mipMaps : texture.MipMapsArray)
+		{
+			WriteValue(stream, static_cast<u32>(mipMaps.size()));
+			for (const auto& mipMap : mipMaps)
+			{
+				WriteValue(stream, mipMap.Size);
+				WriteValue(stream, mipMap.Format);
+				WriteValue(stream, mipMap.DataSize);
+				stream.write(reinterpret_cast<const char*>(mipMap.Data.get()), mipMap.DataSize);
+			}
+		}
+
+		return static_cast<b8>(stream.flush());
+	}
+
+	void TextureCacheKeyBuilder::Add(const void* data, size_t byteSize)
+	{
+		const u8* bytes = static_cast<const u8*>(data);
+		totalByteSize += byteSize;
+
+		while (byteSize > 0)
+		{
+			// NOTE: Trailing bytes are zero extended to a full word, the total length is mixed in at the end to tell them apart
+			u64 word = 0;
+			const size_t wordByteSize = Min<size_t>(byteSize, sizeof(word));
+			std::memcpy(&word, bytes, wordByteSize);
+
+			laneA = RotateLeft(laneA ^ (word * HashPrime0), 31) * HashPrime1;
+			laneB = RotateLeft(laneB + (word * HashPrime2), 27) * HashPrime0;
+
+			bytes += wordByteSize;
+			byteSize -= wordByteSize;
+		}
+	}
+
+	TextureCacheKey TextureCacheKeyBuilder::Finish() const
+	{
+		const u64 high = MixBits(laneA ^ (totalByteSize * HashPrime2));
+		const u64 low = MixBits(laneB ^ RotateLeft(laneA, 17) ^ totalByteSize);
+		return TextureCacheKey { high, low };
+	}
+
+	TextureCache::TextureCache(std::string_view directory, u64 maxByteSize) : directory(directory), maxByteSize(maxByteSize)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(this->directory, error);
+
+		for (const auto& file : std::filesystem::directory_iterator(this->directory, error))
+		{
+			if (!file.is_regular_file(error) || file.path().extension() != ".tex")
+				continue;
+
+			auto& entry = entries[file.path().filename().string()];
+			entry.ByteSize = file.file_size(error);
+			entry.LastAccess = file.last_write_time(error).time_since_epoch().count();
+			totalByteSize += entry.ByteSize;
+		}
+
+		EvictLeastRecentlyUsedEntries();
+	}
+
+	b8 TextureCache::TryLoad(const TextureCacheKey& key, Tex& outTexture)
+	{
+		const auto fileName = KeyToFileName(key);
+		const auto path = GetEntryPath(fileName);
+		{
+			const auto lock = std::scoped_lock(mutex);
+			if (entries.find(fileName) == entries.end())
+				return false;
+		}
+
+		// NOTE: Read outside the lock so that multiple textures can be loaded in parallel
+		const b8 success = ReadTextureFile(path, key, outTexture);
+
+		const auto lock = std::scoped_lock(mutex);
+		auto entry = entries.find(fileName);
+
+		if (!success)
+		{
+			// NOTE: Corrupted or outdated entries are simply discarded and later replaced
+			outTexture.MipMapsArray.clear();
+
+			std::error_code error;
+			std::filesystem::remove(path, error);
+			if (!error && entry != entries.end())
+			{
+				totalByteSize -= entry->second.ByteSize;
+				entries.erase(entry);
+			}
+			return false;
+		}
+
+		if (entry != entries.end())
+			MarkEntryUsed(fileName, entry->second);
+
+		return true;
+	}
+
+	void TextureCache::Store(const TextureCacheKey& key, const Tex& texture)
+	{
+		const auto fileName = KeyToFileName(key);
+		const auto path = GetEntryPath(fileName);
+
+		// NOTE: Write to a temporary file first so that a crashed or concurrent run never sees a partially written entry
+		const auto temporaryPath = path + "." + std::to_string(std::hash<std::thread::id> {}(std::this_thread::get_id())) + ".tmp";
+		if (!WriteTextureFile(temporaryPath, key, texture))
+		{
+			std::error_code error;
+			std::filesystem::remove(temporaryPath, error);
+			return;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temporaryPath, error);
+			return;
+		}
+
+		const u64 byteSize = std::filesystem::file_size(path, error);
+		if (error)
+			return;
+
+		const auto lock = std::scoped_lock(mutex);
+		auto& entry = entries[fileName];
+		totalByteSize -= entry.ByteSize;
+		entry.ByteSize = byteSize;
+		totalByteSize += entry.ByteSize;
+
+		MarkEntryUsed(fileName, entry);
+		EvictLeastRecentlyUsedEntries();
+	}
+
+	u64 TextureCache::GetTotalByteSize() const
+	{
+		const auto lock = std::scoped_lock(mutex);
+		return totalByteSize;
+	}
+
+	std::string TextureCache::GetEntryPath(const std::string& fileName) const
+	{
+		return directory + "/" + fileName;
+	}
+
+	void TextureCache::MarkEntryUsed(const std::string& fileName, EntryData& entry)
+	{
+		const auto now = std::filesystem::file_time_type::clock::now();
+		entry.LastAccess = now.time_since_epoch().count();
+
+		std::error_code error;
+		std::filesystem::last_write_time(GetEntryPath(fileName), now, error);
+	}
+
+	void TextureCache::EvictLeastRecentlyUsedEntries()
+	{
+		if (totalByteSize <= maxByteSize)
+			return;
+
+		std::vector<decltype(entries)::iterator> entriesByLastAccess;
+		entriesByLastAccess.reserve(entries.size());
+		for (auto it = entries.begin(); it != entries.end(); it++)
+			entriesByLastAccess.push_back(it);
+
+		std::sort(entriesByLastAccess.begin(), entriesByLastAccess.end(), [](const auto& entryA, const auto& entryB)
+		{
+			return entryA->second.LastAccess < entryB->second.LastAccess;
+		});
+
+		// NOTE: Entries whose file can't be deleted, for example because another process still has it open, are kept
+		//		 so that their size still counts towards the limit and they are tried again during the next eviction
+		for (auto entry : entriesByLastAccess)
+		{
+			if (totalByteSize <= maxByteSize)
+				break;
+
+			std::error_code error;
+			std::filesystem::remove(GetEntryPath(entry->first), error);
+			if (error)
+				continue;
+
+			totalByteSize -= entry->second.ByteSize;
+			entries.erase(entry);
+		}
+	}
+}
@@ -0,0 +1,95 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+#include "core_types.h"
+#include "file_format_spr_set.h"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <mutex>
+
+namespace Comfy
+{
+	struct TextureCacheKey
+	{
+		u64 High, Low;
+
+		constexpr b8 operator==(const TextureCacheKey& other) const { return (High == other.High) && (Low == other.Low); }
+		constexpr b8 operator!=(const TextureCacheKey& other) const { return !(*this == other); }
+	};
+
+	// NOTE: Fast non-cryptographic 128 bit hash over two independent 64 bit lanes, only meant to detect changed input data, not to resist tampering
+	class TextureCacheKeyBuilder
+	{
+	public:
+		void Add(const void* data, size_t byteSize);
+
+		template <typename ValueType>
+		void AddValue(const ValueType& value)
+		{
+			Add(&value, sizeof(value));
+		}
+
+		TextureCacheKey Finish() const;
+
+	private:
+		u64 laneA = 0x9E3779B97F4A7C15;
+		u64 laneB = 0xC2B2AE3D27D4EB4F;
+		u64 totalByteSize = 0;
+	};
+
+	// NOTE: On-disk cache of finished texture mip maps, one file per entry inside the cache directory.
+	//		 Every load and store marks the entry as most recently used and the least recently used entries are deleted once the total size exceeds the limit.
+	//		 The last access is stored as the file modification time so that it carries over between runs
+	class TextureCache : NonCopyable
+	{
+	public:
+		TextureCache(std::string_view directory, u64 maxByteSize);
+		~TextureCache() = default;
+
+	public:
+		b8 TryLoad(const TextureCacheKey& key, Tex& outTexture);
+		void Store(const TextureCacheKey& key, const Tex& texture);
+
+		u64 GetTotalByteSize() const;
+
+	private:
+		struct EntryData
+		{
+			u64 ByteSize;
+			i64 LastAccess;
+		};
+
+		std::string GetEntryPath(const std::string& fileName) const;
+		void MarkEntryUsed(const std::string& fileName, EntryData& entry);
+		void EvictLeastRecentlyUsedEntries();
+
+	private:
+		std::string directory;
+		u64 maxByteSize;
+		u64 totalByteSize = 0;
+
+		mutable std::mutex mutex;
+		std::unordered_map<std::string, EntryData> entries;
+	};
+}
@@ -21,9 +21,22 @@
 // SOFTWARE.
 
 #include "texture_util.h"
+#include "thread_pool.h"
 #include "core_io.h"
 #include <future>
+#include <mutex>
 #include <array>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#define COMFY_TEXTURE_UTIL_SIMD 1
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#define COMFY_TEXTURE_UTIL_SIMD 0
+#endif
 
 #include <zlib.h>
 #define STBIW_MALLOC(sz)        malloc(sz)
@@ -44,6 +57,10 @@ static unsigned char* CustomStbImageZLibCompress2(const unsigned char* inData, i
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+// NOTE: Decoded images are handed out without copying and freed by DecodedImageDeleter through stbi_image_free, which has to match these
+#define STBI_MALLOC(sz)         malloc(sz)
+#define STBI_REALLOC(p,newsz)   realloc(p,newsz)
+#define STBI_FREE(p)            free(p)
 #define STBI_ONLY_JPEG
 #define STBI_ONLY_PNG
 #define STBI_ONLY_BMP
@@ -57,21 +74,96 @@ namespace Comfy
 {
 	static constexpr i32 ChannelsRGBA = 4;
 
-	b8 ReadImageFile(std::string_view filePath, ivec2& outSize, std::unique_ptr<u8[]>& outRGBAPixels)
+	void DecodedImageDeleter::operator()(u8* pixels) const
+	{
+		stbi_image_free(pixels);
+	}
+
+	b8 ReadImageFile(std::string_view filePath, ivec2& outSize, DecodedImagePixels& outRGBAPixels)
+	{
+		// NOTE: With the requested component count the returned buffer is exactly the tightly packed RGBA image, so it can be adopted as is
+		int components;
+		outRGBAPixels.reset(stbi_load(filePath.data(), &outSize.x, &outSize.y, &components, ChannelsRGBA));
+
+		return (outRGBAPixels != nullptr);
+	}
+
+	b8 DecodeImageFileData(const u8* fileData, size_t fileSize, ivec2& outSize, DecodedImagePixels& outRGBAPixels)
 	{
+		if (fileData == nullptr || fileSize == 0 || fileSize > static_cast<size_t>(std::numeric_limits<int>::max()))
+			return false;
+
 		int components;
-		stbi_uc* pixels = stbi_load(filePath.data(), &outSize.x, &outSize.y, &components, ChannelsRGBA);
+		outRGBAPixels.reset(stbi_load_from_memory(fileData, static_cast<int>(fileSize), &outSize.x, &outSize.y, &components, ChannelsRGBA));
+
+		return (outRGBAPixels != nullptr);
+	}
 
-		// HACK: Copy could be avoided by overwriting malloc with new and then moving the pointer directly
-		if (pixels != nullptr)
+	static u32 ReadBigEndianU32(const u8* data)
+	{
+		return (static_cast<u32>(data[0]) << 24) | (static_cast<u32>(data[1]) << 16) | (static_cast<u32>(data[2]) << 8) | static_cast<u32>(data[3]);
+	}
+
+	// NOTE: stbi_info stops reading a PNG right after its IHDR chunk and so misses any tRNS chunk adding transparency to gray or RGB images.
+	//		 Walking the chunks up to the first IDAT is still only a few hundred bytes for any reasonable file
+	static b8 ReadPNGFileInfo(const u8* fileData, size_t fileSize, ImageFileInfo& outInfo)
+	{
+		constexpr u8 signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		constexpr size_t chunkHeaderSize = 8, chunkCRCSize = 4, headerDataSize = 13;
+
+		if (fileSize < sizeof(signature) + chunkHeaderSize + headerDataSize || std::memcmp(fileData, signature, sizeof(signature)) != 0)
+			return false;
+
+		const u8* headerChunk = &fileData[sizeof(signature)];
+		if (ReadBigEndianU32(&headerChunk[0]) != headerDataSize || std::memcmp(&headerChunk[4], "IHDR", 4) != 0)
+			return false;
+
+		const u8* headerData = &headerChunk[chunkHeaderSize];
+		const u32 width = ReadBigEndianU32(&headerData[0]), height = ReadBigEndianU32(&headerData[4]);
+		if (width == 0 || height == 0 || width > static_cast<u32>(std::numeric_limits<i32>::max()) || height > static_cast<u32>(std::numeric_limits<i32>::max()))
+			return false;
+
+		enum PNGColorType : u8 { Gray = 0, RGB = 2, Palette = 3, GrayAlpha = 4, RGBAlpha = 6 };
+		const u8 colorType = headerData[9];
+
+		outInfo.Size = ivec2(static_cast<i32>(width), static_cast<i32>(height));
+		outInfo.HasAlpha = (colorType == GrayAlpha || colorType == RGBAlpha);
+		outInfo.Grayscale = (colorType == Gray || colorType == GrayAlpha);
+
+		for (size_t offset = sizeof(signature) + chunkHeaderSize + headerDataSize + chunkCRCSize; offset + chunkHeaderSize <= fileSize;)
 		{
-			const size_t dataSize = (outSize.x * outSize.y * ChannelsRGBA);
-			outRGBAPixels = std::make_unique<u8[]>(dataSize);
-			std::memcpy(outRGBAPixels.get(), pixels, dataSize);
-			stbi_image_free(pixels);
+			const u8* chunk = &fileData[offset];
+			if (std::memcmp(&chunk[4], "IDAT", 4) == 0 || std::memcmp(&chunk[4], "IEND", 4) == 0)
+				break;
+
+			if (std::memcmp(&chunk[4], "tRNS", 4) == 0)
+			{
+				outInfo.HasAlpha = true;
+				break;
+			}
+
+			offset += chunkHeaderSize + static_cast<size_t>(ReadBigEndianU32(&chunk[0])) + chunkCRCSize;
 		}
 
-		return (outRGBAPixels != nullptr);
+		return true;
+	}
+
+	b8 ReadImageFileInfo(const u8* fileData, size_t fileSize, ImageFileInfo& outInfo)
+	{
+		if (fileData == nullptr || fileSize == 0 || fileSize > static_cast<size_t>(std::numeric_limits<int>::max()))
+			return false;
+
+		if (ReadPNGFileInfo(fileData, fileSize, outInfo))
+			return true;
+
+		// NOTE: For every other supported format the component count reported by the header is exactly what stbi_load would decode
+		int components;
+		if (!stbi_info_from_memory(fileData, static_cast<int>(fileSize), &outInfo.Size.x, &outInfo.Size.y, &components))
+			return false;
+
+		outInfo.HasAlpha = (components == 2 || components == 4);
+		outInfo.Grayscale = (components == 1 || components == 2);
+		return true;
 	}
 
 	b8 WriteImageFile(std::string_view filePath, ivec2 size, const void* rgbaPixels)
@@ -115,6 +207,12 @@ namespace Comfy
 		}
 	}
 
+	// NOTE: DXT1a only maps to the sRGB variant to be told apart from DXT1, the block encoding itself is identical and must not go through any gamma conversion
+	static constexpr DXGI_FORMAT TextureFormatToDXGIBlockFormat(TextureFormat format)
+	{
+		return (format == TextureFormat::DXT1a) ? DXGI_FORMAT_BC1_UNORM : TextureFormatToDXGI(format);
+	}
+
 	static constexpr TextureFormat DXGIFormatToTextureFormat(DXGI_FORMAT format)
 	{
 		switch (format)
@@ -248,8 +346,8 @@ namespace Comfy
 		if (inFormat == TextureFormat::RGB8 && outFormat == TextureFormat::RGBA8)
 			return ConvertRGBToRGBA(size, inData, inByteSize, outData, outByteSize);
 
-		const auto inFormatDXGI = TextureFormatToDXGI(inFormat);
-		const auto outFormatDXGI = TextureFormatToDXGI(outFormat);
+		const auto inFormatDXGI = TextureFormatToDXGIBlockFormat(inFormat);
+		const auto outFormatDXGI = TextureFormatToDXGIBlockFormat(outFormat);
 
 		if (inFormatDXGI == DXGI_FORMAT_UNKNOWN || outFormatDXGI == DXGI_FORMAT_UNKNOWN)
 			return false;
@@ -279,7 +377,202 @@ namespace Comfy
 		return true;
 	}
 
-	b8 CompressTextureData(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize)
+	// NOTE: For each 8 bit value the pair of 5 or 6 bit endpoints whose two-thirds interpolation decodes closest to it, same as most real-time encoders use for single color blocks
+	struct BC1SingleColorTable
+	{
+		std::array<std::array<u8, 2>, 256> Endpoints5;
+		std::array<std::array<u8, 2>, 256> Endpoints6;
+	};
+
+	static const BC1SingleColorTable& GetBC1SingleColorTable()
+	{
+		static const BC1SingleColorTable table = []
+		{
+			auto findEndpoints = [](std::array<std::array<u8, 2>, 256>& outEndpoints, i32 bits)
+			{
+				const i32 maxEndpoint = (1 << bits) - 1;
+				auto expand = [bits](i32 endpoint) { return (endpoint << (8 - bits)) | (endpoint >> (2 * bits - 8)); };
+
+				for (i32 value = 0; value <= U8Max; value++)
+				{
+					i32 bestError = std::numeric_limits<i32>::max(), bestSpread = 0;
+					for (i32 endpoint0 = 0; endpoint0 <= maxEndpoint; endpoint0++)
+					{
+						for (i32 endpoint1 = 0; endpoint1 <= maxEndpoint; endpoint1++)
+						{
+							const i32 error = std::abs(((2 * expand(endpoint0) + expand(endpoint1)) / 3) - value);
+							const i32 spread = std::abs(endpoint0 - endpoint1);
+
+							// NOTE: Prefer close endpoints as decoders differ slightly in how they round the interpolation
+							if (error < bestError || (error == bestError && spread < bestSpread))
+							{
+								bestError = error;
+								bestSpread = spread;
+								outEndpoints[value] = { static_cast<u8>(endpoint0), static_cast<u8>(endpoint1) };
+							}
+						}
+					}
+				}
+			};
+
+			BC1SingleColorTable result;
+			findEndpoints(result.Endpoints5, 5);
+			findEndpoints(result.Endpoints6, 6);
+			return result;
+		}();
+
+		return table;
+	}
+
+	static void EncodeBC1SingleColorBlock(u32 rgbaColor, u8 outBlock[8])
+	{
+		const auto& table = GetBC1SingleColorTable();
+		const auto& r = table.Endpoints5[(rgbaColor >> 0) & 0xFF];
+		const auto& g = table.Endpoints6[(rgbaColor >> 8) & 0xFF];
+		const auto& b = table.Endpoints5[(rgbaColor >> 16) & 0xFF];
+
+		u16 color0 = static_cast<u16>((r[0] << 11) | (g[0] << 5) | b[0]);
+		u16 color1 = static_cast<u16>((r[1] << 11) | (g[1] << 5) | b[1]);
+
+		// NOTE: Index 2 decodes to two-thirds color0, swapping the endpoints keeps the four color mode with the same result at index 3
+		u32 indices = 0xAAAAAAAA;
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+			indices = 0xFFFFFFFF;
+		}
+		else if (color0 == color1)
+		{
+			indices = 0x00000000;
+		}
+
+		std::memcpy(&outBlock[0], &color0, sizeof(color0));
+		std::memcpy(&outBlock[2], &color1, sizeof(color1));
+		std::memcpy(&outBlock[4], &indices, sizeof(indices));
+	}
+
+	static void EncodeBC4SingleValueBlock(u8 value, u8 outBlock[8])
+	{
+		outBlock[0] = value;
+		outBlock[1] = value;
+		std::memset(&outBlock[2], 0, 6);
+	}
+
+	// NOTE: Encodes 4x4 RGBA8 blocks that are either a single color or, for BC1, entirely below the alpha threshold directly.
+	//		 Both are very common across the background and solid sprite areas of an atlas and need no endpoint search at all
+	static b8 TryEncodeUniformBlock(const u8* blockPixels, size_t rowPitch, TextureFormat outFormat, u8* outBlock)
+	{
+		const b8 isBC1 = (outFormat == TextureFormat::DXT1 || outFormat == TextureFormat::DXT1a);
+
+		// NOTE: Only the channels stored by the output format have to match, BC1 only stores whether alpha is above the default threshold of one half
+		const u32 channelMask = (outFormat == TextureFormat::RGTC1) ? 0x000000FF : (outFormat == TextureFormat::RGTC2) ? 0x0000FFFF : isBC1 ? 0x00FFFFFF : 0xFFFFFFFF;
+		auto getPixelKey = [&](u32 pixel) { return (pixel & channelMask) | ((isBC1 && (pixel >> 24) >= 0x80) ? 0xFF000000 : 0x00000000); };
+
+		const u32 firstPixel = reinterpret_cast<const u32*>(blockPixels)[0];
+		const u32 firstKey = getPixelKey(firstPixel);
+
+		b8 allEqual = true, allTransparent = isBC1;
+		for (i32 y = 0; y < 4; y++)
+		{
+			const u32* rowPixels = reinterpret_cast<const u32*>(blockPixels + rowPitch * y);
+			for (i32 x = 0; x < 4; x++)
+			{
+				const u32 key = getPixelKey(rowPixels[x]);
+				allEqual &= (key == firstKey);
+				allTransparent &= ((key & 0xFF000000) == 0);
+			}
+
+			if (!allEqual && !allTransparent)
+				return false;
+		}
+
+		const u8 alpha = static_cast<u8>(firstPixel >> 24);
+		switch (outFormat)
+		{
+		case TextureFormat::DXT1:
+		case TextureFormat::DXT1a:
+			if (allTransparent)
+			{
+				// NOTE: Three color mode with every index set to transparent black
+				constexpr u8 transparentBlock[8] = { 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+				std::memcpy(outBlock, transparentBlock, sizeof(transparentBlock));
+			}
+			else
+			{
+				EncodeBC1SingleColorBlock(firstPixel, outBlock);
+			}
+			return true;
+
+		case TextureFormat::DXT3:
+			std::memset(outBlock, ((alpha * 15 + (U8Max / 2)) / U8Max) * 0x11, 8);
+			EncodeBC1SingleColorBlock(firstPixel, outBlock + 8);
+			return true;
+
+		case TextureFormat::DXT5:
+			EncodeBC4SingleValueBlock(alpha, outBlock);
+			EncodeBC1SingleColorBlock(firstPixel, outBlock + 8);
+			return true;
+
+		case TextureFormat::RGTC1:
+			EncodeBC4SingleValueBlock(static_cast<u8>(firstPixel >> 0), outBlock);
+			return true;
+
+		case TextureFormat::RGTC2:
+			EncodeBC4SingleValueBlock(static_cast<u8>(firstPixel >> 0), outBlock);
+			EncodeBC4SingleValueBlock(static_cast<u8>(firstPixel >> 8), outBlock + 8);
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	// NOTE: Provides the RGBA pixels of a range of rows, either by pointing into an existing buffer or by filling in the scratch buffer.
+	//		 Lets the compression routines stream their input strip by strip instead of requiring the entire image up front
+	using RGBARowSource = std::function<const u32*(i32 firstRow, i32 rowCount, u32* scratchRows)>;
+
+	static RGBARowSource MakeBufferRowSource(ivec2 size, const u8* rgbaData)
+	{
+		return [size, rgbaData](i32 firstRow, i32 rowCount, u32* scratchRows)
+		{
+			return &reinterpret_cast<const u32*>(rgbaData)[static_cast<size_t>(firstRow) * size.x];
+		};
+	}
+
+	// NOTE: Block compressed formats encode each 4x4 pixel block independently so an image can be split into horizontal strips of whole block rows.
+	//		 Each strip is handed to the callback as its first pixel row and row count, all but the first strip are submitted to the shared thread pool
+	//		 so compressing multiple textures at once still never runs more strips in parallel than there are workers
+	template <typename StripFunc>
+	static b8 ForEachBlockRowStrip(ivec2 size, b8 multithreaded, StripFunc processStrip)
+	{
+		constexpr i32 blockSize = 4;
+		constexpr i32 minBlockRowsPerStrip = 8;
+
+		const i32 blockRowCount = (size.y + blockSize - 1) / blockSize;
+		const i32 maxStripCount = multithreaded ? static_cast<i32>(ThreadPool::GetShared().GetWorkerCount()) : 1;
+		const i32 stripCount = Clamp(blockRowCount / minBlockRowsPerStrip, 1, Max(maxStripCount, 1));
+		const i32 stripRowCount = ((blockRowCount + stripCount - 1) / stripCount) * blockSize;
+
+		std::vector<ThreadPool::Task<b8>> stripTasks;
+		stripTasks.reserve(stripCount - 1);
+
+		for (i32 firstRow = stripRowCount; firstRow < size.y; firstRow += stripRowCount)
+		{
+			const i32 rowCount = Min(stripRowCount, size.y - firstRow);
+			stripTasks.push_back(ThreadPool::GetShared().Submit(true, [&processStrip, firstRow, rowCount] { return processStrip(firstRow, rowCount); }));
+		}
+
+		b8 success = processStrip(0, Min(stripRowCount, size.y));
+		for (auto& stripTask : stripTasks)
+			success &= stripTask.Get();
+
+		return success;
+	}
+
+	// NOTE: In-tree range fit and cluster fit encoders backing the Draft and Max quality tiers, defined next to the RGTC encoder they share code with
+	static void EncodeBlockRowsInTree(i32 width, const u8* rgbaRows, i32 rowCount, TextureFormat outFormat, TextureCompressionQuality quality, u8* outBlocks);
+
+	b8 CompressTextureData(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize, TextureCompressionQuality quality, b8 multithreaded)
 	{
 		if (size.x <= 0 || size.y <= 0)
 			return false;
@@ -291,34 +584,148 @@ namespace Comfy
 		if (inByteSize < expectedInputByteSize)
 			return false;
 
-		const auto inFormatDXGI = TextureFormatToDXGI(inFormat);
-		const auto outFormatDXGI = TextureFormatToDXGI(outFormat);
+		if (outByteSize < TextureFormatByteSize(size, outFormat))
+			return false;
+
+		const auto inFormatDXGI = TextureFormatToDXGIBlockFormat(inFormat);
+		const auto outFormatDXGI = TextureFormatToDXGIBlockFormat(outFormat);
 
 		if (inFormatDXGI == DXGI_FORMAT_UNKNOWN || outFormatDXGI == DXGI_FORMAT_UNKNOWN)
 			return false;
 
-		auto inputImage = ::DirectX::Image {};
-		inputImage.width = size.x;
-		inputImage.height = size.y;
-		inputImage.format = inFormatDXGI;
-		inputImage.rowPitch = TextureFormatByteSize(ivec2(size.x, 1), inFormat);
-		inputImage.slicePitch = expectedInputByteSize;
-		inputImage.pixels = const_cast<u8*>(inData);
+		const auto inRowPitch = TextureFormatByteSize(ivec2(size.x, 1), inFormat);
+		const auto outBlockRowPitch = TextureFormatByteSize(ivec2(size.x, 4), outFormat);
 
 		auto compressionFlags = ::DirectX::TEX_COMPRESS_DEFAULT;
 
 		if (true) // NOTE: It seems this yields the best results in most cases
 			compressionFlags |= ::DirectX::TEX_COMPRESS_DITHER;
 
-		auto outputImage = ::DirectX::ScratchImage {};
-		if (FAILED(::DirectX::Compress(inputImage, outFormatDXGI, compressionFlags, ::DirectX::TEX_THRESHOLD_DEFAULT, outputImage)))
-			return false;
+		auto compressRows = [&](const u8* rowsData, i32 rowCount, u8* outRowsData, size_t outRowsByteSize) -> b8
+		{
+			auto inputImage = ::DirectX::Image {};
+			inputImage.width = size.x;
+			inputImage.height = rowCount;
+			inputImage.format = inFormatDXGI;
+			inputImage.rowPitch = inRowPitch;
+			inputImage.slicePitch = inRowPitch * rowCount;
+			inputImage.pixels = const_cast<u8*>(rowsData);
+
+			auto outputImage = ::DirectX::ScratchImage {};
+			if (FAILED(::DirectX::Compress(inputImage, outFormatDXGI, compressionFlags, ::DirectX::TEX_THRESHOLD_DEFAULT, outputImage)))
+				return false;
 
-		if (outByteSize < outputImage.GetPixelsSize())
+			if (outRowsByteSize < outputImage.GetPixelsSize())
+				return false;
+
+			std::memcpy(outRowsData, outputImage.GetPixels(), outputImage.GetPixelsSize());
+			return true;
+		};
+
+		// NOTE: Every block is encoded independently so only the non uniform blocks have to be gathered into a densely packed image for the real encoder.
+		//		 Partial blocks are left to the encoder as it has its own way of padding them
+		const b8 skipUniformBlocks = (inFormat == TextureFormat::RGBA8 && (size.x % 4) == 0);
+		const auto outBlockByteSize = TextureFormatByteSize(ivec2(4, 4), outFormat);
+
+		auto compressStrip = [&](i32 firstRow, i32 rowCount) -> b8
+		{
+			const auto outOffset = outBlockRowPitch * (firstRow / 4);
+
+			if (!skipUniformBlocks || (rowCount % 4) != 0)
+				return compressRows(inData + inRowPitch * firstRow, rowCount, outData + outOffset, outByteSize - outOffset);
+
+			const i32 blocksPerRow = (size.x / 4);
+			std::vector<u8*> gatheredOutBlocks;
+			std::unique_ptr<u8[]> gatheredRowsData;
+
+			for (i32 blockRow = 0; blockRow < (rowCount / 4); blockRow++)
+			{
+				for (i32 blockX = 0; blockX < blocksPerRow; blockX++)
+				{
+					const u8* blockPixels = inData + inRowPitch * (firstRow + blockRow * 4) + (blockX * 4 * sizeof(u32));
+					u8* outBlock = outData + outOffset + (outBlockRowPitch * blockRow) + (outBlockByteSize * blockX);
+
+					if (TryEncodeUniformBlock(blockPixels, inRowPitch, outFormat, outBlock))
+						continue;
+
+					if (gatheredRowsData == nullptr)
+						gatheredRowsData = std::make_unique<u8[]>(inRowPitch * rowCount);
+
+					const size_t gatherIndex = gatheredOutBlocks.size();
+					u8* gatheredBlockPixels = &gatheredRowsData[inRowPitch * (gatherIndex / blocksPerRow) * 4 + (gatherIndex % blocksPerRow) * 4 * sizeof(u32)];
+
+					for (i32 y = 0; y < 4; y++)
+						std::memcpy(gatheredBlockPixels + inRowPitch * y, blockPixels + inRowPitch * y, 4 * sizeof(u32));
+
+					gatheredOutBlocks.push_back(outBlock);
+				}
+			}
+
+			if (gatheredOutBlocks.empty())
+				return true;
+
+			const i32 gatheredRowCount = static_cast<i32>((gatheredOutBlocks.size() + blocksPerRow - 1) / blocksPerRow) * 4;
+			const size_t gatheredOutByteSize = outBlockRowPitch * (gatheredRowCount / 4);
+			auto gatheredOutData = std::make_unique<u8[]>(gatheredOutByteSize);
+
+			if (!compressRows(gatheredRowsData.get(), gatheredRowCount, gatheredOutData.get(), gatheredOutByteSize))
+				return false;
+
+			for (size_t i = 0; i < gatheredOutBlocks.size(); i++)
+				std::memcpy(gatheredOutBlocks[i], &gatheredOutData[outBlockRowPitch * (i / blocksPerRow) + outBlockByteSize * (i % blocksPerRow)], outBlockByteSize);
+
+			return true;
+		};
+
+		// NOTE: The in-tree encoders only read RGBA8, anything else always goes through DirectXTex
+		const b8 useInTreeEncoder = (inFormat == TextureFormat::RGBA8 && TextureFormatBlockSize(outFormat) > 0 && quality != TextureCompressionQuality::Normal);
+
+		return ForEachBlockRowStrip(size, multithreaded, [&](i32 firstRow, i32 rowCount) -> b8
+		{
+			u8* outStripData = outData + outBlockRowPitch * (firstRow / 4);
+
+			if (useInTreeEncoder && quality == TextureCompressionQuality::Draft)
+			{
+				EncodeBlockRowsInTree(size.x, inData + inRowPitch * firstRow, rowCount, outFormat, quality, outStripData);
+				return true;
+			}
+
+			if (!compressStrip(firstRow, rowCount))
+				return false;
+
+			// NOTE: Refines the DirectXTex output in place
+			if (useInTreeEncoder && quality == TextureCompressionQuality::Max)
+				EncodeBlockRowsInTree(size.x, inData + inRowPitch * firstRow, rowCount, outFormat, quality, outStripData);
+
+			return true;
+		});
+	}
+
+	// NOTE: Same as CompressTextureData for RGBA8 input but only ever requests a few block rows of the input at a time
+	static b8 CompressTextureDataFromRows(ivec2 size, const RGBARowSource& rowSource, u8* outData, TextureFormat outFormat, size_t outByteSize, TextureCompressionQuality quality, b8 multithreaded)
+	{
+		if (size.x <= 0 || size.y <= 0 || outByteSize < TextureFormatByteSize(size, outFormat))
 			return false;
 
-		std::memcpy(outData, outputImage.GetPixels(), outputImage.GetPixelsSize());
-		return true;
+		constexpr i32 chunkRowCount = (4 * 4);
+		const auto outBlockRowPitch = TextureFormatByteSize(ivec2(size.x, 4), outFormat);
+
+		return ForEachBlockRowStrip(size, multithreaded, [&](i32 firstStripRow, i32 stripRowCount) -> b8
+		{
+			auto rgbaScratch = std::make_unique<u32[]>(static_cast<size_t>(size.x) * chunkRowCount);
+
+			for (i32 firstRow = firstStripRow; firstRow < (firstStripRow + stripRowCount); firstRow += chunkRowCount)
+			{
+				const i32 rowCount = Min(chunkRowCount, (firstStripRow + stripRowCount) - firstRow);
+				const u32* rgbaRows = rowSource(firstRow, rowCount, rgbaScratch.get());
+
+				const auto chunkOffset = outBlockRowPitch * (firstRow / 4);
+				if (!CompressTextureData(ivec2(size.x, rowCount), reinterpret_cast<const u8*>(rgbaRows), TextureFormat::RGBA8, TextureFormatByteSize(ivec2(size.x, rowCount), TextureFormat::RGBA8), outData + chunkOffset, outFormat, outByteSize - chunkOffset, quality, false))
+					return false;
+			}
+
+			return true;
+		});
 	}
 
 	static constexpr f32 CbCrOffset = 0.503929f;
@@ -385,132 +792,1068 @@ namespace Comfy
 		outYA[1] = static_cast<u8>(inRGBA >> 24);
 	}
 
-	b8 ConvertYACbCrToRGBABuffer(const TexMipMap& mipMapYA, const TexMipMap& mipMapCbCr, u8* outData, size_t outByteSize)
+	static void ConvertRGBAToYACbCrPixelsScalar(const u32* inRGBA, u8* outYA, u8* outCbCr, size_t pixelCount)
 	{
-		if (mipMapYA.Format != TextureFormat::RGTC2 || mipMapCbCr.Format != TextureFormat::RGTC2 || (mipMapYA.Size / 2) != mipMapCbCr.Size)
-			return false;
+		for (size_t i = 0; i < pixelCount; i++)
+			ConvertSinglePixelRGBAToYACbCr(inRGBA[i], &outYA[i * 2], &outCbCr[i * 2]);
+	}
 
-		if (outByteSize < TextureFormatByteSize(mipMapYA.Size, TextureFormat::RGBA8))
-			return false;
+	static void ConvertYACbCrToRGBAPixelsScalar(const u8* inYA, const u8* inCbCr, u32* outRGBA, size_t pixelCount)
+	{
+		for (size_t i = 0; i < pixelCount; i++)
+			outRGBA[i] = ConvertSinglePixelYACbCrToRGBA(&inYA[i * 2], &inCbCr[i * 2]);
+	}
 
-		auto imageFromMip = [](const auto& mip)
-		{
-			auto image = ::DirectX::Image {};
-			image.width = mip.Size.x;
-			image.height = mip.Size.y;
-			image.format = DXGI_FORMAT_BC5_UNORM;
-			image.rowPitch = TextureFormatByteSize(ivec2(mip.Size.x, 1), TextureFormat::RGTC2);
-			image.slicePitch = mip.DataSize;
-			image.pixels = const_cast<u8*>(mip.Data.get());
-			return image;
-		};
+#if COMFY_TEXTURE_UTIL_SIMD
+	// NOTE: The SIMD kernels perform the exact same sequence of single precision multiplies and adds as the scalar functions above
+	//		 (and deliberately no FMA) so that both produce bit identical results. Any remaining tail pixels are handled by the scalar path
 
-		auto outputImageYA = ::DirectX::ScratchImage {};
-		if (FAILED(::DirectX::Decompress(imageFromMip(mipMapYA), DXGI_FORMAT_R8G8_UNORM, outputImageYA)))
-			return false;
+	static SimdLevel DetectSupportedSimdLevel()
+	{
+		i32 cpuInfo[4] = {};
+		__cpuid(cpuInfo, 0);
+		const i32 maxLeaf = cpuInfo[0];
 
-		auto outputImageCbCr = ::DirectX::ScratchImage {};
-		if (FAILED(::DirectX::Decompress(imageFromMip(mipMapCbCr), DXGI_FORMAT_R8G8_UNORM, outputImageCbCr)))
-			return false;
+		if (maxLeaf < 1)
+			return SimdLevel::Scalar;
 
-		auto outputImageCbCrResized = ::DirectX::ScratchImage {};
-		if (FAILED(::DirectX::Resize(*outputImageCbCr.GetImage(0, 0, 0), mipMapYA.Size.x, mipMapYA.Size.y, ::DirectX::TEX_FILTER_LINEAR | ::DirectX::TEX_FILTER_FORCE_NON_WIC, outputImageCbCrResized)))
-			return false;
+		__cpuid(cpuInfo, 1);
+		const b8 hasSSE41 = (cpuInfo[2] & (1 << 19)) != 0;
+		const b8 hasOSXSave = (cpuInfo[2] & (1 << 27)) != 0;
+		const b8 hasAVX = (cpuInfo[2] & (1 << 28)) != 0;
 
-		const u8* pixelBufferYA = (outputImageYA.GetPixels());
-		const u8* pixelBufferCbCrResized = (outputImageCbCrResized.GetPixels());
-		u32* outRGBA = reinterpret_cast<u32*>(outData);
+		if (!hasSSE41)
+			return SimdLevel::Scalar;
 
-		for (size_t y = 0; y < mipMapYA.Size.y; y++)
-		{
-			for (size_t x = 0; x < mipMapYA.Size.x; x++)
-			{
-				const auto pixelIndex = (mipMapYA.Size.x * y + x);
+		// NOTE: The OS also has to save the upper YMM register halves on context switches
+		if (maxLeaf < 7 || !hasOSXSave || !hasAVX || (_xgetbv(0) & 0x6) != 0x6)
+			return SimdLevel::SSE41;
 
-				const u8* inYA = &pixelBufferYA[pixelIndex * 2];
-				const u8* inCbCr = &pixelBufferCbCrResized[pixelIndex * 2];
+		__cpuidex(cpuInfo, 7, 0);
+		const b8 hasAVX2 = (cpuInfo[1] & (1 << 5)) != 0;
 
-				outRGBA[pixelIndex] = ConvertSinglePixelYACbCrToRGBA(inYA, inCbCr);
-			}
-		}
+		return hasAVX2 ? SimdLevel::AVX2 : SimdLevel::SSE41;
+	}
 
-		return true;
+	static __forceinline __m128 PixelU8ToF32SSE(__m128i pixel)
+	{
+		return _mm_mul_ps(_mm_cvtepi32_ps(pixel), _mm_set1_ps(1.0f / static_cast<f32>(U8Max)));
 	}
 
-	b8 ConvertRGBAToYACbCrBuffer(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outYAData, u8* outCbCrData)
+	static __forceinline __m128i PixelF32ToU8SSE(__m128 pixel)
 	{
-		if (inFormat != TextureFormat::RGBA8)
-			return false;
+		return _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(pixel, _mm_setzero_ps()), _mm_set1_ps(1.0f)), _mm_set1_ps(static_cast<f32>(U8Max))));
+	}
 
-		const auto inRGBAData = reinterpret_cast<const u32*>(inData);
+	static __forceinline __m128 DotSSE(__m128 x, __m128 y, __m128 z, const vec3& row)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(row.x)), _mm_mul_ps(y, _mm_set1_ps(row.y))), _mm_mul_ps(z, _mm_set1_ps(row.z)));
+	}
 
-		for (size_t y = 0; y < size.y; y++)
-		{
-			for (size_t x = 0; x < size.x; x++)
-			{
-				const auto pixelIndex = (size.x * y + x);
+	static __forceinline __m256 PixelU8ToF32AVX2(__m256i pixel)
+	{
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(pixel), _mm256_set1_ps(1.0f / static_cast<f32>(U8Max)));
+	}
 
-				u8* outYA = &outYAData[pixelIndex * 2];
-				u8* outCbCr = &outCbCrData[pixelIndex * 2];
+	static __forceinline __m256i PixelF32ToU8AVX2(__m256 pixel)
+	{
+		return _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(pixel, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)), _mm256_set1_ps(static_cast<f32>(U8Max))));
+	}
 
-				ConvertSinglePixelRGBAToYACbCr(inRGBAData[pixelIndex], outYA, outCbCr);
-			}
+	static __forceinline __m256 DotAVX2(__m256 x, __m256 y, __m256 z, const vec3& row)
+	{
+		return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(row.x)), _mm256_mul_ps(y, _mm256_set1_ps(row.y))), _mm256_mul_ps(z, _mm256_set1_ps(row.z)));
+	}
+
+	// NOTE: Returns the YA pixels in the low and the CbCr pixels in the high 16 bits of each lane
+	static __forceinline void ConvertFourPixelsRGBAToYACbCrSSE(__m128i rgba, __m128i& outYA, __m128i& outCbCr)
+	{
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+		const __m128 r = PixelU8ToF32SSE(_mm_and_si128(rgba, byteMask));
+		const __m128 g = PixelU8ToF32SSE(_mm_and_si128(_mm_srli_epi32(rgba, 8), byteMask));
+		const __m128 b = PixelU8ToF32SSE(_mm_and_si128(_mm_srli_epi32(rgba, 16), byteMask));
+
+		const __m128 cbCrOffset = _mm_set1_ps(CbCrOffset);
+		const __m128 cbCrFactor = _mm_set1_ps(1.0f / CbCrFactor);
+
+		const __m128i y = PixelF32ToU8SSE(DotSSE(r, g, b, RGBToYCbCrTransform[1]));
+		const __m128i cb = PixelF32ToU8SSE(_mm_mul_ps(_mm_add_ps(DotSSE(r, g, b, RGBToYCbCrTransform[2]), cbCrOffset), cbCrFactor));
+		const __m128i cr = PixelF32ToU8SSE(_mm_mul_ps(_mm_add_ps(DotSSE(r, g, b, RGBToYCbCrTransform[0]), cbCrOffset), cbCrFactor));
+
+		outYA = _mm_or_si128(y, _mm_slli_epi32(_mm_srli_epi32(rgba, 24), 8));
+		outCbCr = _mm_or_si128(cb, _mm_slli_epi32(cr, 8));
+	}
+
+	static void ConvertRGBAToYACbCrPixelsSSE41(const u32* inRGBA, u8* outYA, u8* outCbCr, size_t pixelCount)
+	{
+		constexpr size_t pixelsPerIteration = 8;
+		const size_t simdPixelCount = (pixelCount / pixelsPerIteration) * pixelsPerIteration;
+
+		for (size_t i = 0; i < simdPixelCount; i += pixelsPerIteration)
+		{
+			__m128i yaLow, cbCrLow, yaHigh, cbCrHigh;
+			ConvertFourPixelsRGBAToYACbCrSSE(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&inRGBA[i + 0])), yaLow, cbCrLow);
+			ConvertFourPixelsRGBAToYACbCrSSE(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&inRGBA[i + 4])), yaHigh, cbCrHigh);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&outYA[i * 2]), _mm_packus_epi32(yaLow, yaHigh));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&outCbCr[i * 2]), _mm_packus_epi32(cbCrLow, cbCrHigh));
+		}
+
+		ConvertRGBAToYACbCrPixelsScalar(&inRGBA[simdPixelCount], &outYA[simdPixelCount * 2], &outCbCr[simdPixelCount * 2], pixelCount - simdPixelCount);
+	}
+
+	static __forceinline void ConvertEightPixelsRGBAToYACbCrAVX2(__m256i rgba, __m256i& outYA, __m256i& outCbCr)
+	{
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256 r = PixelU8ToF32AVX2(_mm256_and_si256(rgba, byteMask));
+		const __m256 g = PixelU8ToF32AVX2(_mm256_and_si256(_mm256_srli_epi32(rgba, 8), byteMask));
+		const __m256 b = PixelU8ToF32AVX2(_mm256_and_si256(_mm256_srli_epi32(rgba, 16), byteMask));
+
+		const __m256 cbCrOffset = _mm256_set1_ps(CbCrOffset);
+		const __m256 cbCrFactor = _mm256_set1_ps(1.0f / CbCrFactor);
+
+		const __m256i y = PixelF32ToU8AVX2(DotAVX2(r, g, b, RGBToYCbCrTransform[1]));
+		const __m256i cb = PixelF32ToU8AVX2(_mm256_mul_ps(_mm256_add_ps(DotAVX2(r, g, b, RGBToYCbCrTransform[2]), cbCrOffset), cbCrFactor));
+		const __m256i cr = PixelF32ToU8AVX2(_mm256_mul_ps(_mm256_add_ps(DotAVX2(r, g, b, RGBToYCbCrTransform[0]), cbCrOffset), cbCrFactor));
+
+		outYA = _mm256_or_si256(y, _mm256_slli_epi32(_mm256_srli_epi32(rgba, 24), 8));
+		outCbCr = _mm256_or_si256(cb, _mm256_slli_epi32(cr, 8));
+	}
+
+	static void ConvertRGBAToYACbCrPixelsAVX2(const u32* inRGBA, u8* outYA, u8* outCbCr, size_t pixelCount)
+	{
+		constexpr size_t pixelsPerIteration = 16;
+		const size_t simdPixelCount = (pixelCount / pixelsPerIteration) * pixelsPerIteration;
+
+		for (size_t i = 0; i < simdPixelCount; i += pixelsPerIteration)
+		{
+			__m256i yaLow, cbCrLow, yaHigh, cbCrHigh;
+			ConvertEightPixelsRGBAToYACbCrAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&inRGBA[i + 0])), yaLow, cbCrLow);
+			ConvertEightPixelsRGBAToYACbCrAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&inRGBA[i + 8])), yaHigh, cbCrHigh);
+
+			// NOTE: The AVX2 pack instructions operate on each 128 bit lane separately so the 64 bit quarters have to be reordered afterwards
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&outYA[i * 2]), _mm256_permute4x64_epi64(_mm256_packus_epi32(yaLow, yaHigh), 0b11'01'10'00));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&outCbCr[i * 2]), _mm256_permute4x64_epi64(_mm256_packus_epi32(cbCrLow, cbCrHigh), 0b11'01'10'00));
+		}
+
+		ConvertRGBAToYACbCrPixelsScalar(&inRGBA[simdPixelCount], &outYA[simdPixelCount * 2], &outCbCr[simdPixelCount * 2], pixelCount - simdPixelCount);
+	}
+
+	// NOTE: Takes the YA and CbCr pixels zero extended to 32 bits per lane
+	static __forceinline __m128i ConvertFourPixelsYACbCrToRGBASSE(__m128i ya, __m128i cbCr)
+	{
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+		const __m128 cbCrFactor = _mm_set1_ps(CbCrFactor);
+		const __m128 cbCrOffset = _mm_set1_ps(CbCrOffset);
+
+		const __m128 x = _mm_sub_ps(_mm_mul_ps(PixelU8ToF32SSE(_mm_srli_epi32(cbCr, 8)), cbCrFactor), cbCrOffset);
+		const __m128 y = PixelU8ToF32SSE(_mm_and_si128(ya, byteMask));
+		const __m128 z = _mm_sub_ps(_mm_mul_ps(PixelU8ToF32SSE(_mm_and_si128(cbCr, byteMask)), cbCrFactor), cbCrOffset);
+
+		const __m128i r = PixelF32ToU8SSE(DotSSE(x, y, z, YCbCrToRGBTransform[0]));
+		const __m128i g = PixelF32ToU8SSE(DotSSE(x, y, z, YCbCrToRGBTransform[1]));
+		const __m128i b = PixelF32ToU8SSE(DotSSE(x, y, z, YCbCrToRGBTransform[2]));
+		const __m128i a = _mm_srli_epi32(ya, 8);
+
+		return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+	}
+
+	static void ConvertYACbCrToRGBAPixelsSSE41(const u8* inYA, const u8* inCbCr, u32* outRGBA, size_t pixelCount)
+	{
+		constexpr size_t pixelsPerIteration = 8;
+		const size_t simdPixelCount = (pixelCount / pixelsPerIteration) * pixelsPerIteration;
+
+		for (size_t i = 0; i < simdPixelCount; i += pixelsPerIteration)
+		{
+			const __m128i ya = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inYA[i * 2]));
+			const __m128i cbCr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inCbCr[i * 2]));
+
+			const __m128i rgbaLow = ConvertFourPixelsYACbCrToRGBASSE(_mm_cvtepu16_epi32(ya), _mm_cvtepu16_epi32(cbCr));
+			const __m128i rgbaHigh = ConvertFourPixelsYACbCrToRGBASSE(_mm_cvtepu16_epi32(_mm_srli_si128(ya, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(cbCr, 8)));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&outRGBA[i + 0]), rgbaLow);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&outRGBA[i + 4]), rgbaHigh);
+		}
+
+		ConvertYACbCrToRGBAPixelsScalar(&inYA[simdPixelCount * 2], &inCbCr[simdPixelCount * 2], &outRGBA[simdPixelCount], pixelCount - simdPixelCount);
+	}
+
+	static __forceinline __m256i ConvertEightPixelsYACbCrToRGBAAVX2(__m256i ya, __m256i cbCr)
+	{
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256 cbCrFactor = _mm256_set1_ps(CbCrFactor);
+		const __m256 cbCrOffset = _mm256_set1_ps(CbCrOffset);
+
+		const __m256 x = _mm256_sub_ps(_mm256_mul_ps(PixelU8ToF32AVX2(_mm256_srli_epi32(cbCr, 8)), cbCrFactor), cbCrOffset);
+		const __m256 y = PixelU8ToF32AVX2(_mm256_and_si256(ya, byteMask));
+		const __m256 z = _mm256_sub_ps(_mm256_mul_ps(PixelU8ToF32AVX2(_mm256_and_si256(cbCr, byteMask)), cbCrFactor), cbCrOffset);
+
+		const __m256i r = PixelF32ToU8AVX2(DotAVX2(x, y, z, YCbCrToRGBTransform[0]));
+		const __m256i g = PixelF32ToU8AVX2(DotAVX2(x, y, z, YCbCrToRGBTransform[1]));
+		const __m256i b = PixelF32ToU8AVX2(DotAVX2(x, y, z, YCbCrToRGBTransform[2]));
+		const __m256i a = _mm256_srli_epi32(ya, 8);
+
+		return _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_slli_epi32(a, 24)));
+	}
+
+	static void ConvertYACbCrToRGBAPixelsAVX2(const u8* inYA, const u8* inCbCr, u32* outRGBA, size_t pixelCount)
+	{
+		constexpr size_t pixelsPerIteration = 16;
+		const size_t simdPixelCount = (pixelCount / pixelsPerIteration) * pixelsPerIteration;
+
+		for (size_t i = 0; i < simdPixelCount; i += pixelsPerIteration)
+		{
+			const __m128i yaLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inYA[i * 2 + 0]));
+			const __m128i yaHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inYA[i * 2 + 16]));
+			const __m128i cbCrLow = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inCbCr[i * 2 + 0]));
+			const __m128i cbCrHigh = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inCbCr[i * 2 + 16]));
+
+			const __m256i rgbaLow = ConvertEightPixelsYACbCrToRGBAAVX2(_mm256_cvtepu16_epi32(yaLow), _mm256_cvtepu16_epi32(cbCrLow));
+			const __m256i rgbaHigh = ConvertEightPixelsYACbCrToRGBAAVX2(_mm256_cvtepu16_epi32(yaHigh), _mm256_cvtepu16_epi32(cbCrHigh));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&outRGBA[i + 0]), rgbaLow);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(&outRGBA[i + 8]), rgbaHigh);
+		}
+
+		ConvertYACbCrToRGBAPixelsScalar(&inYA[simdPixelCount * 2], &inCbCr[simdPixelCount * 2], &outRGBA[simdPixelCount], pixelCount - simdPixelCount);
+	}
+#else
+	static SimdLevel DetectSupportedSimdLevel()
+	{
+		return SimdLevel::Scalar;
+	}
+#endif /* COMFY_TEXTURE_UTIL_SIMD */
+
+	static std::atomic<SimdLevel> MaxSimdLevel = SimdLevel::Count;
+
+	SimdLevel GetSupportedSimdLevel()
+	{
+		static const SimdLevel supportedLevel = DetectSupportedSimdLevel();
+		return supportedLevel;
+	}
+
+	void SetMaxSimdLevel(SimdLevel level)
+	{
+		MaxSimdLevel = level;
+	}
+
+	static SimdLevel GetActiveSimdLevel()
+	{
+		return Min(GetSupportedSimdLevel(), MaxSimdLevel.load());
+	}
+
+	void ConvertRGBAToYACbCrPixels(const u32* inRGBA, u8* outYA, u8* outCbCr, size_t pixelCount)
+	{
+		switch (GetActiveSimdLevel())
+		{
+#if COMFY_TEXTURE_UTIL_SIMD
+		case SimdLevel::AVX2: return ConvertRGBAToYACbCrPixelsAVX2(inRGBA, outYA, outCbCr, pixelCount);
+		case SimdLevel::SSE41: return ConvertRGBAToYACbCrPixelsSSE41(inRGBA, outYA, outCbCr, pixelCount);
+#endif
+		default: return ConvertRGBAToYACbCrPixelsScalar(inRGBA, outYA, outCbCr, pixelCount);
 		}
+	}
+
+	void ConvertYACbCrToRGBAPixels(const u8* inYA, const u8* inCbCr, u32* outRGBA, size_t pixelCount)
+	{
+		switch (GetActiveSimdLevel())
+		{
+#if COMFY_TEXTURE_UTIL_SIMD
+		case SimdLevel::AVX2: return ConvertYACbCrToRGBAPixelsAVX2(inYA, inCbCr, outRGBA, pixelCount);
+		case SimdLevel::SSE41: return ConvertYACbCrToRGBAPixelsSSE41(inYA, inCbCr, outRGBA, pixelCount);
+#endif
+		default: return ConvertYACbCrToRGBAPixelsScalar(inYA, inCbCr, outRGBA, pixelCount);
+		}
+	}
+
+	b8 ConvertYACbCrToRGBABuffer(const TexMipMap& mipMapYA, const TexMipMap& mipMapCbCr, u8* outData, size_t outByteSize)
+	{
+		if (mipMapYA.Format != TextureFormat::RGTC2 || mipMapCbCr.Format != TextureFormat::RGTC2 || (mipMapYA.Size / 2) != mipMapCbCr.Size)
+			return false;
+
+		if (outByteSize < TextureFormatByteSize(mipMapYA.Size, TextureFormat::RGBA8))
+			return false;
+
+		auto imageFromMip = [](const auto& mip)
+		{
+			auto image = ::DirectX::Image {};
+			image.width = mip.Size.x;
+			image.height = mip.Size.y;
+			image.format = DXGI_FORMAT_BC5_UNORM;
+			image.rowPitch = TextureFormatByteSize(ivec2(mip.Size.x, 1), TextureFormat::RGTC2);
+			image.slicePitch = mip.DataSize;
+			image.pixels = const_cast<u8*>(mip.Data.get());
+			return image;
+		};
+
+		auto outputImageYA = ::DirectX::ScratchImage {};
+		if (FAILED(::DirectX::Decompress(imageFromMip(mipMapYA), DXGI_FORMAT_R8G8_UNORM, outputImageYA)))
+			return false;
+
+		auto outputImageCbCr = ::DirectX::ScratchImage {};
+		if (FAILED(::DirectX::Decompress(imageFromMip(mipMapCbCr), DXGI_FORMAT_R8G8_UNORM, outputImageCbCr)))
+			return false;
+
+		auto outputImageCbCrResized = ::DirectX::ScratchImage {};
+		if (FAILED(::DirectX::Resize(*outputImageCbCr.GetImage(0, 0, 0), mipMapYA.Size.x, mipMapYA.Size.y, ::DirectX::TEX_FILTER_LINEAR | ::DirectX::TEX_FILTER_FORCE_NON_WIC, outputImageCbCrResized)))
+			return false;
+
+		const u8* pixelBufferYA = (outputImageYA.GetPixels());
+		const u8* pixelBufferCbCrResized = (outputImageCbCrResized.GetPixels());
+		u32* outRGBA = reinterpret_cast<u32*>(outData);
+
+		ConvertYACbCrToRGBAPixels(pixelBufferYA, pixelBufferCbCrResized, outRGBA, static_cast<size_t>(mipMapYA.Size.x) * mipMapYA.Size.y);
+		return true;
+	}
+
+	b8 ConvertRGBAToYACbCrBuffer(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outYAData, u8* outCbCrData)
+	{
+		if (inFormat != TextureFormat::RGBA8)
+			return false;
+
+		const auto inRGBAData = reinterpret_cast<const u32*>(inData);
 
+		ConvertRGBAToYACbCrPixels(inRGBAData, outYAData, outCbCrData, static_cast<size_t>(size.x) * size.y);
 		return true;
 	}
 
-	b8 CreateYACbCrTexture(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, Tex& outTexture)
+	static constexpr i32 RGTCBlockSize = 4;
+	static constexpr i32 RGTCBlockPixelCount = (RGTCBlockSize * RGTCBlockSize);
+	static constexpr i32 RGTCPaletteSize = 8;
+
+	// NOTE: Decoded values of all eight indices, rounded to nearest as most decoders do
+	static void GetRGTCBlockPalette(i32 endpoint0, i32 endpoint1, i32 outPalette[RGTCPaletteSize])
+	{
+		outPalette[0] = endpoint0;
+		outPalette[1] = endpoint1;
+
+		if (endpoint0 > endpoint1)
+		{
+			for (i32 i = 1; i < 7; i++)
+				outPalette[i + 1] = ((7 - i) * endpoint0 + i * endpoint1 + 3) / 7;
+		}
+		else
+		{
+			for (i32 i = 1; i < 5; i++)
+				outPalette[i + 1] = ((5 - i) * endpoint0 + i * endpoint1 + 2) / 5;
+
+			outPalette[6] = 0;
+			outPalette[7] = U8Max;
+		}
+	}
+
+	// NOTE: Picks the closest palette entry for each value and returns the total squared error
+	static u32 FindRGTCBlockIndices(const u8 values[RGTCBlockPixelCount], i32 endpoint0, i32 endpoint1, u8 outIndices[RGTCBlockPixelCount])
+	{
+		i32 palette[RGTCPaletteSize];
+		GetRGTCBlockPalette(endpoint0, endpoint1, palette);
+
+		u32 totalError = 0;
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			i32 bestError = std::numeric_limits<i32>::max();
+			u8 bestIndex = 0;
+
+			for (i32 paletteIndex = 0; paletteIndex < RGTCPaletteSize; paletteIndex++)
+			{
+				const i32 difference = (values[i] - palette[paletteIndex]);
+				const i32 error = (difference * difference);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = static_cast<u8>(paletteIndex);
+				}
+			}
+
+			outIndices[i] = bestIndex;
+			totalError += static_cast<u32>(bestError);
+		}
+
+		return totalError;
+	}
+
+	struct RGTCBlockCandidate
+	{
+		i32 Endpoint0, Endpoint1;
+		u32 Error;
+		u8 Indices[RGTCBlockPixelCount];
+	};
+
+	static void TryRGTCBlockEndpoints(const u8 values[RGTCBlockPixelCount], i32 endpoint0, i32 endpoint1, RGTCBlockCandidate& inOutBest)
+	{
+		RGTCBlockCandidate candidate;
+		candidate.Endpoint0 = endpoint0;
+		candidate.Endpoint1 = endpoint1;
+		candidate.Error = FindRGTCBlockIndices(values, endpoint0, endpoint1, candidate.Indices);
+
+		if (candidate.Error < inOutBest.Error)
+			inOutBest = candidate;
+	}
+
+	// NOTE: Least squares fit of the eight value mode endpoints to the current index assignment, the interpolation weights are kept in sevenths
+	static b8 RefitRGTCBlockEndpoints(const u8 values[RGTCBlockPixelCount], const u8 indices[RGTCBlockPixelCount], i32& outEndpoint0, i32& outEndpoint1)
+	{
+		i64 weight00 = 0, weight01 = 0, weight11 = 0, value0 = 0, value1 = 0;
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			const i32 step = (indices[i] == 0) ? 0 : (indices[i] == 1) ? 7 : (indices[i] - 1);
+			const i64 weight0 = (7 - step), weight1 = step;
+
+			weight00 += weight0 * weight0;
+			weight01 += weight0 * weight1;
+			weight11 += weight1 * weight1;
+			value0 += weight0 * values[i];
+			value1 += weight1 * values[i];
+		}
+
+		const i64 determinant = (weight00 * weight11) - (weight01 * weight01);
+		if (determinant == 0)
+			return false;
+
+		auto solveRounded = [determinant](i64 numerator) { return static_cast<i32>(Clamp<i64>((2 * 7 * numerator + determinant) / (2 * determinant), 0, U8Max)); };
+		outEndpoint0 = solveRounded((value0 * weight11) - (value1 * weight01));
+		outEndpoint1 = solveRounded((value1 * weight00) - (value0 * weight01));
+
+		return (outEndpoint0 > outEndpoint1);
+	}
+
+	static void EncodeRGTCBlock(const u8 values[RGTCBlockPixelCount], RGTCQuality quality, u8 outBlock[8])
+	{
+		i32 minValue = U8Max, maxValue = 0;
+		i32 minInnerValue = U8Max, maxInnerValue = 0;
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			minValue = Min<i32>(minValue, values[i]);
+			maxValue = Max<i32>(maxValue, values[i]);
+
+			if (values[i] != 0 && values[i] != U8Max)
+			{
+				minInnerValue = Min<i32>(minInnerValue, values[i]);
+				maxInnerValue = Max<i32>(maxInnerValue, values[i]);
+			}
+		}
+
+		// NOTE: Uniform blocks are extremely common and trivially encoded exactly
+		if (minValue == maxValue)
+		{
+			EncodeBC4SingleValueBlock(static_cast<u8>(minValue), outBlock);
+			return;
+		}
+
+		RGTCBlockCandidate best;
+		best.Error = std::numeric_limits<u32>::max();
+
+		// NOTE: Eight interpolated values spanning the full range of the block
+		TryRGTCBlockEndpoints(values, maxValue, minValue, best);
+
+		if (quality != RGTCQuality::Fast && best.Error > 0)
+		{
+			// NOTE: Six interpolated values plus explicit 0 and 255 for blocks with a few extreme outliers
+			if (minValue == 0 || maxValue == U8Max)
+			{
+				if (minInnerValue <= maxInnerValue)
+					TryRGTCBlockEndpoints(values, minInnerValue, maxInnerValue, best);
+				else
+					TryRGTCBlockEndpoints(values, 0, 0, best);
+			}
+
+			i32 refitEndpoint0, refitEndpoint1;
+			if (best.Endpoint0 > best.Endpoint1 && RefitRGTCBlockEndpoints(values, best.Indices, refitEndpoint0, refitEndpoint1))
+				TryRGTCBlockEndpoints(values, refitEndpoint0, refitEndpoint1, best);
+		}
+
+		if (quality == RGTCQuality::High && best.Error > 0)
+		{
+			// NOTE: Brute force the neighborhood of the best endpoints found so far
+			constexpr i32 searchRadius = 3;
+			const i32 centerEndpoint0 = best.Endpoint0, centerEndpoint1 = best.Endpoint1;
+
+			for (i32 offset0 = -searchRadius; offset0 <= searchRadius; offset0++)
+			{
+				for (i32 offset1 = -searchRadius; offset1 <= searchRadius; offset1++)
+				{
+					const i32 endpoint0 = (centerEndpoint0 + offset0), endpoint1 = (centerEndpoint1 + offset1);
+					if ((offset0 == 0 && offset1 == 0) || endpoint0 < 0 || endpoint0 > U8Max || endpoint1 < 0 || endpoint1 > U8Max)
+						continue;
+
+					// NOTE: Stay within the same mode as otherwise the palette changes completely
+					if ((endpoint0 > endpoint1) != (centerEndpoint0 > centerEndpoint1))
+						continue;
+
+					TryRGTCBlockEndpoints(values, endpoint0, endpoint1, best);
+				}
+			}
+		}
+
+		outBlock[0] = static_cast<u8>(best.Endpoint0);
+		outBlock[1] = static_cast<u8>(best.Endpoint1);
+
+		u64 packedIndices = 0;
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+			packedIndices |= (static_cast<u64>(best.Indices[i]) << (i * 3));
+
+		for (i32 i = 0; i < 6; i++)
+			outBlock[2 + i] = static_cast<u8>(packedIndices >> (i * 8));
+	}
+
+	// NOTE: Encodes all blocks of a tightly packed image with 1 or 2 interleaved channels, the output blocks of each channel are interleaved the same way
+	static void EncodeRGTCImage(ivec2 size, const u8* inData, i32 channelCount, RGTCQuality quality, u8* outData)
+	{
+		const ivec2 blockCount = ivec2((size.x + RGTCBlockSize - 1) / RGTCBlockSize, (size.y + RGTCBlockSize - 1) / RGTCBlockSize);
+		u8* outBlock = outData;
+
+		for (i32 blockY = 0; blockY < blockCount.y; blockY++)
+		{
+			for (i32 blockX = 0; blockX < blockCount.x; blockX++)
+			{
+				for (i32 channel = 0; channel < channelCount; channel++)
+				{
+					// NOTE: Partial edge blocks repeat the last row and column of the image
+					u8 values[RGTCBlockPixelCount];
+					for (i32 y = 0; y < RGTCBlockSize; y++)
+					{
+						const i32 pixelY = Min(blockY * RGTCBlockSize + y, size.y - 1);
+						for (i32 x = 0; x < RGTCBlockSize; x++)
+						{
+							const i32 pixelX = Min(blockX * RGTCBlockSize + x, size.x - 1);
+							values[y * RGTCBlockSize + x] = inData[(static_cast<size_t>(pixelY) * size.x + pixelX) * channelCount + channel];
+						}
+					}
+
+					EncodeRGTCBlock(values, quality, outBlock);
+					outBlock += 8;
+				}
+			}
+		}
+	}
+
+	b8 CompressRGTCData(ivec2 size, const u8* inData, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize, RGTCQuality quality, b8 multithreaded)
 	{
 		if (size.x <= 0 || size.y <= 0)
 			return false;
 
-		if (inFormat != TextureFormat::RGBA8)
+		if (outFormat != TextureFormat::RGTC1 && outFormat != TextureFormat::RGTC2)
 			return false;
 
-		const auto fullSize = size;
-		const auto halfSize = size / 2;
+		const i32 channelCount = static_cast<i32>(TextureFormatChannelCount(outFormat));
+		if (inByteSize < static_cast<size_t>(size.x) * size.y * channelCount || outByteSize < TextureFormatByteSize(size, outFormat))
+			return false;
+
+		const size_t inRowPitch = static_cast<size_t>(size.x) * channelCount;
+		const size_t outBlockRowPitch = TextureFormatByteSize(ivec2(size.x, RGTCBlockSize), outFormat);
+
+		// NOTE: Strips start at block row boundaries so only the last one can end in a partial block row, just like the full image
+		return ForEachBlockRowStrip(size, multithreaded, [&](i32 firstRow, i32 rowCount) -> b8
+		{
+			EncodeRGTCImage(ivec2(size.x, rowCount), inData + inRowPitch * firstRow, channelCount, quality, outData + outBlockRowPitch * (firstRow / RGTCBlockSize));
+			return true;
+		});
+	}
+
+	static u32 CalculateRGTCBlockError(const u8 values[RGTCBlockPixelCount], const u8 block[8])
+	{
+		i32 palette[RGTCPaletteSize];
+		GetRGTCBlockPalette(block[0], block[1], palette);
+
+		u64 packedIndices = 0;
+		for (i32 i = 0; i < 6; i++)
+			packedIndices |= (static_cast<u64>(block[2 + i]) << (i * 8));
 
-		auto yaBuffer = std::make_unique<u8[]>(fullSize.x * fullSize.y * 2);
-		auto fullCbCrBuffer = std::make_unique<u8[]>(fullSize.x * fullSize.y * 2);
+		u32 totalError = 0;
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			const i32 difference = (values[i] - palette[(packedIndices >> (i * 3)) & 0x7]);
+			totalError += static_cast<u32>(difference * difference);
+		}
+
+		return totalError;
+	}
 
-		if (!ConvertRGBAToYACbCrBuffer(fullSize, inData, inFormat, inByteSize, yaBuffer.get(), fullCbCrBuffer.get()))
+	static void EncodeRGTCChannelBlockInTree(const u32 pixels[RGTCBlockPixelCount], i32 channel, TextureCompressionQuality quality, u8 inOutBlock[8])
+	{
+		u8 values[RGTCBlockPixelCount];
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+			values[i] = static_cast<u8>(pixels[i] >> (channel * 8));
+
+		u8 block[8];
+		EncodeRGTCBlock(values, (quality == TextureCompressionQuality::Max) ? RGTCQuality::High : RGTCQuality::Fast, block);
+
+		if (quality != TextureCompressionQuality::Max || CalculateRGTCBlockError(values, block) < CalculateRGTCBlockError(values, inOutBlock))
+			std::memcpy(inOutBlock, block, sizeof(block));
+	}
+
+	// NOTE: Explicit 4 bit alpha is simply rounded to the nearest representable value
+	static void EncodeBC2AlphaBlock(const u32 pixels[RGTCBlockPixelCount], u8 outBlock[8])
+	{
+		std::memset(outBlock, 0, 8);
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			const u32 alpha = ((pixels[i] >> 24) * 15 + (U8Max / 2)) / U8Max;
+			outBlock[i / 2] |= static_cast<u8>(alpha << ((i % 2) * 4));
+		}
+	}
+
+	// NOTE: Opaque pixels decoded as transparent and vice versa are penalized as if every channel was off by the full range
+	static constexpr i32 BC1TransparencyMismatchError = (3 * U8Max * U8Max);
+
+	struct BC1BlockCandidate
+	{
+		u16 Color0, Color1;
+		u32 Indices;
+		u32 Error;
+	};
+
+	// NOTE: Visible colors of a block along with their mean and principal axis, BC1 blocks only store whether each pixel is above half alpha
+	struct BC1BlockColors
+	{
+		i32 Count;
+		b8 AnyTransparent;
+		f32 Colors[RGTCBlockPixelCount][3];
+		f32 Mean[3];
+		f32 Axis[3];
+	};
+
+	static void UnpackRGB565(u16 packed, i32 outRGB[3])
+	{
+		const i32 r = (packed >> 11) & 0x1F, g = (packed >> 5) & 0x3F, b = (packed >> 0) & 0x1F;
+		outRGB[0] = (r << 3) | (r >> 2);
+		outRGB[1] = (g << 2) | (g >> 4);
+		outRGB[2] = (b << 3) | (b >> 2);
+	}
+
+	static u16 PackRGB565(const f32 rgb[3])
+	{
+		auto quantize = [](f32 value, i32 maxValue) { return Clamp(static_cast<i32>(value * (static_cast<f32>(maxValue) / U8Max) + 0.5f), 0, maxValue); };
+		return static_cast<u16>((quantize(rgb[0], 0x1F) << 11) | (quantize(rgb[1], 0x3F) << 5) | (quantize(rgb[2], 0x1F) << 0));
+	}
+
+	// NOTE: Same interpolation as the single color table, the color part of DXT3 / DXT5 blocks is always decoded in four color mode
+	static void GetBC1BlockPalette(u16 color0, u16 color1, b8 forceFourColor, i32 outPalette[4][4])
+	{
+		i32 endpoint0[3], endpoint1[3];
+		UnpackRGB565(color0, endpoint0);
+		UnpackRGB565(color1, endpoint1);
+
+		const b8 fourColorMode = (forceFourColor || color0 > color1);
+		for (i32 c = 0; c < 3; c++)
+		{
+			outPalette[0][c] = endpoint0[c];
+			outPalette[1][c] = endpoint1[c];
+			outPalette[2][c] = fourColorMode ? ((2 * endpoint0[c] + endpoint1[c]) / 3) : ((endpoint0[c] + endpoint1[c]) / 2);
+			outPalette[3][c] = fourColorMode ? ((endpoint0[c] + 2 * endpoint1[c]) / 3) : 0;
+		}
+
+		outPalette[0][3] = outPalette[1][3] = outPalette[2][3] = U8Max;
+		outPalette[3][3] = fourColorMode ? U8Max : 0;
+	}
+
+	static i32 GetBC1PixelError(u32 pixel, const i32 paletteColor[4], b8 matchTransparency)
+	{
+		const b8 wantsTransparent = (matchTransparency && (pixel >> 24) < 0x80);
+		const b8 isTransparent = (paletteColor[3] == 0);
+
+		if (wantsTransparent || isTransparent)
+			return (wantsTransparent == isTransparent) ? 0 : BC1TransparencyMismatchError;
+
+		i32 error = 0;
+		for (i32 c = 0; c < 3; c++)
+		{
+			const i32 difference = static_cast<i32>((pixel >> (c * 8)) & 0xFF) - paletteColor[c];
+			error += (difference * difference);
+		}
+		return error;
+	}
+
+	static u32 CalculateBC1BlockError(const u32 pixels[RGTCBlockPixelCount], const u8 block[8], b8 forceFourColor, b8 matchTransparency)
+	{
+		u16 color0, color1;
+		u32 indices;
+		std::memcpy(&color0, &block[0], sizeof(color0));
+		std::memcpy(&color1, &block[2], sizeof(color1));
+		std::memcpy(&indices, &block[4], sizeof(indices));
+
+		i32 palette[4][4];
+		GetBC1BlockPalette(color0, color1, forceFourColor, palette);
+
+		u32 totalError = 0;
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+			totalError += static_cast<u32>(GetBC1PixelError(pixels[i], palette[(indices >> (i * 2)) & 0x3], matchTransparency));
+
+		return totalError;
+	}
+
+	static void TryBC1BlockEndpoints(const u32 pixels[RGTCBlockPixelCount], u16 color0, u16 color1, b8 forceFourColor, b8 matchTransparency, BC1BlockCandidate& inOutBest)
+	{
+		i32 palette[4][4];
+		GetBC1BlockPalette(color0, color1, forceFourColor, palette);
+
+		BC1BlockCandidate candidate = { color0, color1, 0, 0 };
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			i32 bestError = std::numeric_limits<i32>::max(), bestIndex = 0;
+			for (i32 paletteIndex = 0; paletteIndex < 4; paletteIndex++)
+			{
+				const i32 error = GetBC1PixelError(pixels[i], palette[paletteIndex], matchTransparency);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = paletteIndex;
+				}
+			}
+
+			candidate.Indices |= (static_cast<u32>(bestIndex) << (i * 2));
+			candidate.Error += static_cast<u32>(bestError);
+		}
+
+		if (candidate.Error < inOutBest.Error)
+			inOutBest = candidate;
+	}
+
+	static void GatherBC1BlockColors(const u32 pixels[RGTCBlockPixelCount], b8 matchTransparency, BC1BlockColors& outColors)
+	{
+		outColors = {};
+		for (i32 i = 0; i < RGTCBlockPixelCount; i++)
+		{
+			if (matchTransparency && (pixels[i] >> 24) < 0x80)
+			{
+				outColors.AnyTransparent = true;
+				continue;
+			}
+
+			for (i32 c = 0; c < 3; c++)
+			{
+				outColors.Colors[outColors.Count][c] = static_cast<f32>((pixels[i] >> (c * 8)) & 0xFF);
+				outColors.Mean[c] += outColors.Colors[outColors.Count][c];
+			}
+			outColors.Count++;
+		}
+
+		if (outColors.Count == 0)
+			return;
+
+		for (i32 c = 0; c < 3; c++)
+			outColors.Mean[c] /= static_cast<f32>(outColors.Count);
+
+		f32 covariance[3][3] = {};
+		for (i32 i = 0; i < outColors.Count; i++)
+		{
+			for (i32 row = 0; row < 3; row++)
+			{
+				for (i32 column = 0; column < 3; column++)
+					covariance[row][column] += (outColors.Colors[i][row] - outColors.Mean[row]) * (outColors.Colors[i][column] - outColors.Mean[column]);
+			}
+		}
+
+		// NOTE: A few rounds of power iteration are plenty to find the principal axis of at most 16 colors,
+		//		 starting from the covariance of the channel with the largest variance so it can't be orthogonal to it
+		const i32 maxVarianceChannel = (covariance[0][0] >= covariance[1][1] && covariance[0][0] >= covariance[2][2]) ? 0 : (covariance[1][1] >= covariance[2][2]) ? 1 : 2;
+		if (covariance[maxVarianceChannel][maxVarianceChannel] <= 0.0f)
+			return;
+
+		f32 axis[3] = { covariance[0][maxVarianceChannel], covariance[1][maxVarianceChannel], covariance[2][maxVarianceChannel] };
+		for (i32 iteration = 0; iteration < 8; iteration++)
+		{
+			f32 nextAxis[3] = {};
+			for (i32 row = 0; row < 3; row++)
+				nextAxis[row] = (covariance[row][0] * axis[0]) + (covariance[row][1] * axis[1]) + (covariance[row][2] * axis[2]);
+
+			const f32 maxComponent = Max(std::abs(nextAxis[0]), Max(std::abs(nextAxis[1]), std::abs(nextAxis[2])));
+			if (maxComponent <= 0.0f)
+				break;
+
+			for (i32 c = 0; c < 3; c++)
+				axis[c] = (nextAxis[c] / maxComponent);
+		}
+
+		const f32 axisLength = std::sqrt((axis[0] * axis[0]) + (axis[1] * axis[1]) + (axis[2] * axis[2]));
+		for (i32 c = 0; c < 3; c++)
+			outColors.Axis[c] = (axis[c] / axisLength);
+	}
+
+	static f32 ProjectOntoBC1BlockAxis(const BC1BlockColors& colors, i32 colorIndex)
+	{
+		return ((colors.Colors[colorIndex][0] - colors.Mean[0]) * colors.Axis[0]) + ((colors.Colors[colorIndex][1] - colors.Mean[1]) * colors.Axis[1]) + ((colors.Colors[colorIndex][2] - colors.Mean[2]) * colors.Axis[2]);
+	}
+
+	// NOTE: Four color mode needs the first endpoint to be the larger one and the three color mode with transparency the opposite
+	static void TryBC1BlockEndpointPair(const u32 pixels[RGTCBlockPixelCount], const f32 endpoint0[3], const f32 endpoint1[3], b8 threeColorMode, b8 forceFourColor, b8 matchTransparency, BC1BlockCandidate& inOutBest)
+	{
+		u16 color0 = PackRGB565(endpoint0), color1 = PackRGB565(endpoint1);
+		if (threeColorMode ? (color0 > color1) : (color0 < color1))
+			std::swap(color0, color1);
+
+		TryBC1BlockEndpoints(pixels, color0, color1, forceFourColor, matchTransparency, inOutBest);
+	}
+
+	// NOTE: Endpoints at the extremes of the colors projected onto their principal axis
+	static void RangeFitBC1Block(const u32 pixels[RGTCBlockPixelCount], const BC1BlockColors& colors, b8 forceFourColor, b8 matchTransparency, BC1BlockCandidate& inOutBest)
+	{
+		f32 minProjection = 0.0f, maxProjection = 0.0f;
+		for (i32 i = 0; i < colors.Count; i++)
+		{
+			const f32 projection = ProjectOntoBC1BlockAxis(colors, i);
+			minProjection = Min(minProjection, projection);
+			maxProjection = Max(maxProjection, projection);
+		}
+
+		f32 start[3], end[3];
+		for (i32 c = 0; c < 3; c++)
+		{
+			start[c] = colors.Mean[c] + (colors.Axis[c] * minProjection);
+			end[c] = colors.Mean[c] + (colors.Axis[c] * maxProjection);
+		}
+
+		TryBC1BlockEndpointPair(pixels, end, start, (matchTransparency && colors.AnyTransparent), forceFourColor, matchTransparency, inOutBest);
+	}
+
+	// NOTE: Tries every ordered split of the colors sorted along the principal axis into the four palette entries
+	//		 and solves for the least squares endpoints of each, snapped to the 565 grid before comparing their error
+	static void ClusterFitBC1Block(const u32 pixels[RGTCBlockPixelCount], const BC1BlockColors& colors, b8 forceFourColor, b8 matchTransparency, BC1BlockCandidate& inOutBest)
+	{
+		const i32 count = colors.Count;
+
+		std::array<i32, RGTCBlockPixelCount> order;
+		std::array<f32, RGTCBlockPixelCount> projections;
+		for (i32 i = 0; i < count; i++)
+		{
+			order[i] = i;
+			projections[i] = ProjectOntoBC1BlockAxis(colors, i);
+		}
+		std::sort(order.begin(), order.begin() + count, [&](i32 a, i32 b) { return projections[a] < projections[b]; });
+
+		f32 prefixSums[RGTCBlockPixelCount + 1][3] = {};
+		for (i32 i = 0; i < count; i++)
+		{
+			for (i32 c = 0; c < 3; c++)
+				prefixSums[i + 1][c] = prefixSums[i][c] + colors.Colors[order[i]][c];
+		}
+
+		auto snapToGrid = [](f32 value, i32 maxValue)
+		{
+			const i32 quantized = Clamp(static_cast<i32>(value * (static_cast<f32>(maxValue) / U8Max) + 0.5f), 0, maxValue);
+			return (maxValue == 0x3F) ? static_cast<f32>((quantized << 2) | (quantized >> 4)) : static_cast<f32>((quantized << 3) | (quantized >> 2));
+		};
+
+		f32 bestError = std::numeric_limits<f32>::max(), bestStart[3] = {}, bestEnd[3] = {};
+		for (i32 split0 = 0; split0 <= count; split0++)
+		{
+			for (i32 split1 = split0; split1 <= count; split1++)
+			{
+				for (i32 split2 = split1; split2 <= count; split2++)
+				{
+					// NOTE: Weights of the start endpoint for the clusters at 0, 1/3, 2/3 and 1 along the axis
+					const f32 count0 = static_cast<f32>(split0), count1 = static_cast<f32>(split1 - split0);
+					const f32 count2 = static_cast<f32>(split2 - split1), count3 = static_cast<f32>(count - split2);
+
+					const f32 alpha2 = count0 + (count1 * (4.0f / 9.0f)) + (count2 * (1.0f / 9.0f));
+					const f32 beta2 = count3 + (count2 * (4.0f / 9.0f)) + (count1 * (1.0f / 9.0f));
+					const f32 alphaBeta = (count1 + count2) * (2.0f / 9.0f);
+
+					const f32 determinant = (alpha2 * beta2) - (alphaBeta * alphaBeta);
+					if (std::abs(determinant) < 1e-6f)
+						continue;
+
+					f32 start[3], end[3], error = 0.0f;
+					for (i32 c = 0; c < 3; c++)
+					{
+						const f32 sum0 = prefixSums[split0][c], sum1 = prefixSums[split1][c] - prefixSums[split0][c];
+						const f32 sum2 = prefixSums[split2][c] - prefixSums[split1][c], sum3 = prefixSums[count][c] - prefixSums[split2][c];
+
+						const f32 alphaX = sum0 + (sum1 * (2.0f / 3.0f)) + (sum2 * (1.0f / 3.0f));
+						const f32 betaX = sum3 + (sum2 * (2.0f / 3.0f)) + (sum1 * (1.0f / 3.0f));
+
+						const i32 maxValue = (c == 1) ? 0x3F : 0x1F;
+						start[c] = snapToGrid(((alphaX * beta2) - (betaX * alphaBeta)) / determinant, maxValue);
+						end[c] = snapToGrid(((betaX * alpha2) - (alphaX * alphaBeta)) / determinant, maxValue);
+
+						// NOTE: Squared error up to the constant sum of squared colors, which is the same for every split
+						error += (start[c] * start[c] * alpha2) + (end[c] * end[c] * beta2) + 2.0f * ((start[c] * end[c] * alphaBeta) - (start[c] * alphaX) - (end[c] * betaX));
+					}
+
+					if (error < bestError)
+					{
+						bestError = error;
+						std::copy(std::begin(start), std::end(start), std::begin(bestStart));
+						std::copy(std::begin(end), std::end(end), std::begin(bestEnd));
+					}
+				}
+			}
+		}
+
+		if (bestError < std::numeric_limits<f32>::max())
+			TryBC1BlockEndpointPair(pixels, bestStart, bestEnd, false, forceFourColor, matchTransparency, inOutBest);
+	}
+
+	// NOTE: Greedily steps each endpoint channel to its neighboring 565 values for as long as that keeps lowering the error
+	static void RefineBC1BlockEndpoints(const u32 pixels[RGTCBlockPixelCount], b8 forceFourColor, b8 matchTransparency, BC1BlockCandidate& inOutBest)
+	{
+		constexpr i32 maxPasses = 8;
+		constexpr i32 channelShifts[3] = { 11, 5, 0 };
+		constexpr i32 channelMasks[3] = { 0x1F, 0x3F, 0x1F };
+
+		for (i32 pass = 0; pass < maxPasses && inOutBest.Error > 0; pass++)
+		{
+			const u32 previousError = inOutBest.Error;
+			for (i32 endpoint = 0; endpoint < 2; endpoint++)
+			{
+				for (i32 c = 0; c < 3; c++)
+				{
+					for (const i32 step : { -1, +1 })
+					{
+						const u16 color = (endpoint == 0) ? inOutBest.Color0 : inOutBest.Color1;
+						const i32 value = ((color >> channelShifts[c]) & channelMasks[c]) + step;
+						if (value < 0 || value > channelMasks[c])
+							continue;
+
+						const u16 steppedColor = static_cast<u16>((color & ~(channelMasks[c] << channelShifts[c])) | (value << channelShifts[c]));
+						TryBC1BlockEndpoints(pixels, (endpoint == 0) ? steppedColor : inOutBest.Color0, (endpoint == 1) ? steppedColor : inOutBest.Color1, forceFourColor, matchTransparency, inOutBest);
+					}
+				}
+			}
+
+			if (inOutBest.Error >= previousError)
+				break;
+		}
+	}
+
+	static void EncodeBC1ColorBlockInTree(const u32 pixels[RGTCBlockPixelCount], b8 forceFourColor, b8 matchTransparency, TextureCompressionQuality quality, u8 inOutBlock[8])
+	{
+		BC1BlockColors colors;
+		GatherBC1BlockColors(pixels, matchTransparency, colors);
+
+		BC1BlockCandidate best;
+		best.Error = std::numeric_limits<u32>::max();
+		RangeFitBC1Block(pixels, colors, forceFourColor, matchTransparency, best);
+
+		if (quality == TextureCompressionQuality::Max)
+		{
+			if (best.Error > 0 && !(matchTransparency && colors.AnyTransparent))
+				ClusterFitBC1Block(pixels, colors, forceFourColor, matchTransparency, best);
+
+			RefineBC1BlockEndpoints(pixels, forceFourColor, matchTransparency, best);
+
+			// NOTE: Keep the existing DirectXTex encoding if it still turns out to be better
+			if (CalculateBC1BlockError(pixels, inOutBlock, forceFourColor, matchTransparency) <= best.Error)
+				return;
+		}
+
+		std::memcpy(&inOutBlock[0], &best.Color0, sizeof(best.Color0));
+		std::memcpy(&inOutBlock[2], &best.Color1, sizeof(best.Color1));
+		std::memcpy(&inOutBlock[4], &best.Indices, sizeof(best.Indices));
+	}
+
+	static void EncodeBlockInTree(const u32 pixels[RGTCBlockPixelCount], TextureFormat outFormat, TextureCompressionQuality quality, u8* inOutBlock)
+	{
+		if (TryEncodeUniformBlock(reinterpret_cast<const u8*>(pixels), RGTCBlockSize * sizeof(u32), outFormat, inOutBlock))
+			return;
+
+		switch (outFormat)
+		{
+		case TextureFormat::DXT1:
+		case TextureFormat::DXT1a:
+			EncodeBC1ColorBlockInTree(pixels, false, true, quality, inOutBlock);
+			break;
+
+		case TextureFormat::DXT3:
+			EncodeBC2AlphaBlock(pixels, inOutBlock);
+			EncodeBC1ColorBlockInTree(pixels, true, false, quality, inOutBlock + 8);
+			break;
+
+		case TextureFormat::DXT5:
+			EncodeRGTCChannelBlockInTree(pixels, 3, quality, inOutBlock);
+			EncodeBC1ColorBlockInTree(pixels, true, false, quality, inOutBlock + 8);
+			break;
+
+		case TextureFormat::RGTC1:
+			EncodeRGTCChannelBlockInTree(pixels, 0, quality, inOutBlock);
+			break;
+
+		case TextureFormat::RGTC2:
+			EncodeRGTCChannelBlockInTree(pixels, 0, quality, inOutBlock);
+			EncodeRGTCChannelBlockInTree(pixels, 1, quality, inOutBlock + 8);
+			break;
+
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	static void EncodeBlockRowsInTree(i32 width, const u8* rgbaRows, i32 rowCount, TextureFormat outFormat, TextureCompressionQuality quality, u8* outBlocks)
+	{
+		const ivec2 blockCount = ivec2((width + RGTCBlockSize - 1) / RGTCBlockSize, (rowCount + RGTCBlockSize - 1) / RGTCBlockSize);
+		const size_t outBlockByteSize = TextureFormatBlockSize(outFormat);
+		u8* outBlock = outBlocks;
+
+		for (i32 blockY = 0; blockY < blockCount.y; blockY++)
+		{
+			for (i32 blockX = 0; blockX < blockCount.x; blockX++)
+			{
+				// NOTE: Partial edge blocks repeat the last row and column of the image, same as the RGTC encoder
+				u32 pixels[RGTCBlockPixelCount];
+				for (i32 y = 0; y < RGTCBlockSize; y++)
+				{
+					const i32 pixelY = Min(blockY * RGTCBlockSize + y, rowCount - 1);
+					for (i32 x = 0; x < RGTCBlockSize; x++)
+						pixels[y * RGTCBlockSize + x] = reinterpret_cast<const u32*>(rgbaRows)[static_cast<size_t>(pixelY) * width + Min(blockX * RGTCBlockSize + x, width - 1)];
+				}
+
+				EncodeBlockInTree(pixels, outFormat, quality, outBlock);
+				outBlock += outBlockByteSize;
+			}
+		}
+	}
+
+	// NOTE: 2x2 box filter of two full resolution CbCr rows into one half resolution row.
+	//		 Same weights as the linear filter of DirectX::Resize for an exact 2x reduction, but rounding ties up instead of to even can differ by 1 LSB
+	static void DownsampleCbCrRowPair(const u8* inCbCrRow0, const u8* inCbCrRow1, u8* outHalfCbCrRow, i32 halfWidth)
+	{
+		for (i32 x = 0; x < halfWidth * 2; x++)
+		{
+			const i32 left = (x / 2) * 4 + (x % 2), right = left + 2;
+			outHalfCbCrRow[x] = static_cast<u8>((inCbCrRow0[left] + inCbCrRow0[right] + inCbCrRow1[left] + inCbCrRow1[right] + 2) / 4);
+		}
+	}
+
+	// NOTE: Odd sizes are no exact 2x reduction, the linear filter then blends between source pixels at fractional positions
+	//		 so these still convert and resize the full resolution planes as a whole to keep the CbCr plane identical to DirectX::Resize
+	static b8 CreateYACbCrMipMapsFromWholePlanes(ivec2 fullSize, ivec2 halfSize, const RGBARowSource& rowSource, TexMipMap& outMipMapYA, TexMipMap& outMipMapCbCr, RGTCQuality quality, b8 multithreaded)
+	{
+		auto rgbaScratch = std::make_unique<u32[]>(static_cast<size_t>(fullSize.x) * fullSize.y);
+		const u32* rgbaPixels = rowSource(0, fullSize.y, rgbaScratch.get());
+
+		auto yaBuffer = std::make_unique<u8[]>(static_cast<size_t>(fullSize.x) * fullSize.y * 2);
+		auto fullCbCrBuffer = std::make_unique<u8[]>(static_cast<size_t>(fullSize.x) * fullSize.y * 2);
+
+		if (!ConvertRGBAToYACbCrBuffer(fullSize, reinterpret_cast<const u8*>(rgbaPixels), TextureFormat::RGBA8, static_cast<size_t>(fullSize.x) * fullSize.y * 4, yaBuffer.get(), fullCbCrBuffer.get()))
 			return false;
 
+		rgbaScratch.reset();
+
 		auto fullCbCr = ::DirectX::Image {};
 		fullCbCr.width = fullSize.x;
 		fullCbCr.height = fullSize.y;
 		fullCbCr.format = DXGI_FORMAT_R8G8_UNORM;
-		fullCbCr.rowPitch = fullSize.x * 2;
-		fullCbCr.slicePitch = fullSize.x * fullSize.y * 2;
+		fullCbCr.rowPitch = static_cast<size_t>(fullSize.x) * 2;
+		fullCbCr.slicePitch = static_cast<size_t>(fullSize.x) * fullSize.y * 2;
 		fullCbCr.pixels = fullCbCrBuffer.get();
 
 		auto halfCbCr = ::DirectX::ScratchImage {};
 		if (FAILED(::DirectX::Resize(fullCbCr, halfSize.x, halfSize.y, ::DirectX::TEX_FILTER_LINEAR | ::DirectX::TEX_FILTER_FORCE_NON_WIC, halfCbCr)))
 			return false;
 
-		auto halfCbCrSource = ::DirectX::Image {};
-		halfCbCrSource.width = halfSize.x;
-		halfCbCrSource.height = halfSize.y;
-		halfCbCrSource.format = DXGI_FORMAT_R8G8_UNORM;
-		halfCbCrSource.rowPitch = halfSize.x * 2;
-		halfCbCrSource.slicePitch = halfSize.x * halfSize.y * 2;
-		halfCbCrSource.pixels = halfCbCr.GetPixels();
-
-		auto compressedHalfCbCr = ::DirectX::ScratchImage {};
-		if (FAILED(::DirectX::Compress(halfCbCrSource, DXGI_FORMAT_BC5_UNORM, ::DirectX::TEX_COMPRESS_UNIFORM, ::DirectX::TEX_THRESHOLD_DEFAULT, compressedHalfCbCr)))
+		if (!CompressRGTCData(fullSize, yaBuffer.get(), static_cast<size_t>(fullSize.x) * fullSize.y * 2, outMipMapYA.Data.get(), TextureFormat::RGTC2, outMipMapYA.DataSize, quality, multithreaded))
 			return false;
 
-		auto yaSource = ::DirectX::Image {};
-		yaSource.width = fullSize.x;
-		yaSource.height = fullSize.y;
-		yaSource.format = DXGI_FORMAT_R8G8_UNORM;
-		yaSource.rowPitch = fullSize.x * 2;
-		yaSource.slicePitch = fullSize.x * fullSize.y * 2;
-		yaSource.pixels = yaBuffer.get();
+		return CompressRGTCData(halfSize, halfCbCr.GetPixels(), halfCbCr.GetPixelsSize(), outMipMapCbCr.Data.get(), TextureFormat::RGTC2, outMipMapCbCr.DataSize, quality, multithreaded);
+	}
+
+	static b8 CreateYACbCrTextureFromRows(ivec2 size, const RGBARowSource& rowSource, Tex& outTexture, RGTCQuality quality, b8 multithreaded)
+	{
+		const auto fullSize = size;
+		const auto halfSize = size / 2;
 
-		auto compressedYA = ::DirectX::ScratchImage {};
-		if (FAILED(::DirectX::Compress(yaSource, DXGI_FORMAT_BC5_UNORM, ::DirectX::TEX_COMPRESS_UNIFORM, ::DirectX::TEX_THRESHOLD_DEFAULT, compressedYA)))
+		if (halfSize.x <= 0 || halfSize.y <= 0)
 			return false;
 
 		outTexture.MipMapsArray.resize(1);
@@ -530,10 +1873,58 @@ namespace Comfy
 			mip.Data = std::make_unique<u8[]>(mip.DataSize);
 		}
 
-		std::memcpy(mipMapYA.Data.get(), compressedYA.GetPixels(), mipMapYA.DataSize);
-		std::memcpy(mipMapCbCr.Data.get(), compressedHalfCbCr.GetPixels(), mipMapCbCr.DataSize);
+		if ((fullSize.x % 2) != 0 || (fullSize.y % 2) != 0)
+			return CreateYACbCrMipMapsFromWholePlanes(fullSize, halfSize, rowSource, mipMapYA, mipMapCbCr, quality, multithreaded);
 
-		return true;
+		const size_t yaBlockRowPitch = TextureFormatByteSize(ivec2(fullSize.x, RGTCBlockSize), TextureFormat::RGTC2);
+		const size_t cbCrBlockRowPitch = TextureFormatByteSize(ivec2(halfSize.x, RGTCBlockSize), TextureFormat::RGTC2);
+
+		// NOTE: One half resolution CbCr block row at a time, which covers two full resolution YA block rows
+		constexpr i32 chunkHalfRowCount = RGTCBlockSize;
+		constexpr i32 maxChunkRowCount = (chunkHalfRowCount * 2);
+
+		// NOTE: Each strip is converted, downsampled and encoded in chunks of block rows so that neither plane ever has to exist uncompressed
+		return ForEachBlockRowStrip(halfSize, multithreaded, [&](i32 firstHalfRow, i32 halfRowCount) -> b8
+		{
+			auto rgbaScratch = std::make_unique<u32[]>(static_cast<size_t>(fullSize.x) * maxChunkRowCount);
+			auto yaChunk = std::make_unique<u8[]>(static_cast<size_t>(fullSize.x) * maxChunkRowCount * 2);
+			auto halfCbCrChunk = std::make_unique<u8[]>(static_cast<size_t>(halfSize.x) * chunkHalfRowCount * 2);
+			auto cbCrRowPair = std::make_unique<u8[]>(static_cast<size_t>(fullSize.x) * 2 * 2);
+
+			for (i32 chunkHalfRow = firstHalfRow; chunkHalfRow < (firstHalfRow + halfRowCount); chunkHalfRow += chunkHalfRowCount)
+			{
+				const i32 halfRows = Min(chunkHalfRowCount, (firstHalfRow + halfRowCount) - chunkHalfRow);
+				const i32 firstRow = (chunkHalfRow * 2);
+				const i32 rowCount = (halfRows * 2);
+
+				const u32* rgbaRows = rowSource(firstRow, rowCount, rgbaScratch.get());
+
+				for (i32 row = 0; row < rowCount; row++)
+				{
+					u8* cbCrRow = &cbCrRowPair[static_cast<size_t>(row % 2) * fullSize.x * 2];
+					ConvertRGBAToYACbCrPixels(&rgbaRows[static_cast<size_t>(row) * fullSize.x], &yaChunk[static_cast<size_t>(row) * fullSize.x * 2], cbCrRow, fullSize.x);
+
+					if ((row % 2) == 1)
+						DownsampleCbCrRowPair(&cbCrRowPair[0], &cbCrRowPair[fullSize.x * 2], &halfCbCrChunk[static_cast<size_t>(row / 2) * halfSize.x * 2], halfSize.x);
+				}
+
+				EncodeRGTCImage(ivec2(fullSize.x, rowCount), yaChunk.get(), 2, quality, mipMapYA.Data.get() + yaBlockRowPitch * (firstRow / RGTCBlockSize));
+				EncodeRGTCImage(ivec2(halfSize.x, halfRows), halfCbCrChunk.get(), 2, quality, mipMapCbCr.Data.get() + cbCrBlockRowPitch * (chunkHalfRow / RGTCBlockSize));
+			}
+
+			return true;
+		});
+	}
+
+	b8 CreateYACbCrTexture(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, Tex& outTexture, RGTCQuality quality, b8 multithreaded)
+	{
+		if (size.x <= 0 || size.y <= 0)
+			return false;
+
+		if (inFormat != TextureFormat::RGBA8 || inByteSize < TextureFormatByteSize(size, inFormat))
+			return false;
+
+		return CreateYACbCrTextureFromRows(size, MakeBufferRowSource(size, inData), outTexture, quality, multithreaded);
 	}
 
 	b8 ConvertTextureToRGBABuffer(const Tex& inTexture, u8* outData, size_t outByteSize, i32 cubeFace)
@@ -709,28 +2100,159 @@ namespace Comfy
 		return box.y + box.w;
 	}
 
-	static constexpr ivec2 GetBoxPos(const ivec4& box)
-	{
-		return ivec2(box.x, box.y);
+	static constexpr ivec2 GetBoxPos(const ivec4& box)
+	{
+		return ivec2(box.x, box.y);
+	}
+
+	static constexpr ivec2 GetBoxSize(const ivec4& box)
+	{
+		return ivec2(box.z, box.w);
+	}
+
+	static constexpr i32 OccupancyBitsPerWord = (sizeof(u64) * BitsPerByte);
+
+	static constexpr i32 HighestSetBitIndex(u64 value)
+	{
+		i32 index = 0;
+		for (i32 shift = (OccupancyBitsPerWord / 2); shift > 0; shift /= 2)
+		{
+			if (value >> shift)
+			{
+				value >>= shift;
+				index += shift;
+			}
+		}
+		return index;
+	}
+
+	static void InitializeOccupancy(SprTexOccupancy& outOccupancy, ivec2 texSize)
+	{
+		outOccupancy.Size = texSize;
+		outOccupancy.WordsPerRow = (texSize.x + OccupancyBitsPerWord - 1) / OccupancyBitsPerWord;
+		outOccupancy.Bits.assign(static_cast<size_t>(outOccupancy.WordsPerRow) * texSize.y, 0);
+	}
+
+	static void MarkOccupied(SprTexOccupancy& occupancy, const ivec4& box)
+	{
+		// NOTE: Oversized sprites may extend beyond the texture, those pixels can never be tested against anyway
+		const i32 minX = Max(box.x, 0), maxX = Min(GetBoxRight(box), occupancy.Size.x);
+		const i32 minY = Max(box.y, 0), maxY = Min(GetBoxBottom(box), occupancy.Size.y);
+
+		if (minX >= maxX)
+			return;
+
+		const i32 firstWord = (minX / OccupancyBitsPerWord);
+		const i32 lastWord = ((maxX - 1) / OccupancyBitsPerWord);
+
+		const u64 firstWordMask = (~0ull << (minX % OccupancyBitsPerWord));
+		const u64 lastWordMask = (~0ull >> (OccupancyBitsPerWord - 1 - ((maxX - 1) % OccupancyBitsPerWord)));
+
+		for (i32 y = minY; y < maxY; y++)
+		{
+			u64* rowBits = &occupancy.Bits[static_cast<size_t>(occupancy.WordsPerRow) * y];
+			for (i32 word = firstWord; word <= lastWord; word++)
+			{
+				u64 mask = ~0ull;
+				if (word == firstWord)
+					mask &= firstWordMask;
+				if (word == lastWord)
+					mask &= lastWordMask;
+
+				rowBits[word] |= mask;
+			}
+		}
 	}
 
-	static constexpr ivec2 GetBoxSize(const ivec4& box)
+	// NOTE: Returns the right most occupied column of the first row overlapping the box, or -1 if the whole box is free.
+	//		 Any box starting left of or at that column while covering the same rows is therefore known to be occupied too
+	static i32 FindOccupiedColumn(const SprTexOccupancy& occupancy, const ivec4& box)
 	{
-		return ivec2(box.z, box.w);
+		const i32 firstWord = (box.x / OccupancyBitsPerWord);
+		const i32 lastWord = ((GetBoxRight(box) - 1) / OccupancyBitsPerWord);
+
+		const u64 firstWordMask = (~0ull << (box.x % OccupancyBitsPerWord));
+		const u64 lastWordMask = (~0ull >> (OccupancyBitsPerWord - 1 - ((GetBoxRight(box) - 1) % OccupancyBitsPerWord)));
+
+		for (i32 y = box.y; y < GetBoxBottom(box); y++)
+		{
+			const u64* rowBits = &occupancy.Bits[static_cast<size_t>(occupancy.WordsPerRow) * y];
+			for (i32 word = lastWord; word >= firstWord; word--)
+			{
+				u64 bits = rowBits[word];
+				if (word == lastWord)
+					bits &= lastWordMask;
+				if (word == firstWord)
+					bits &= firstWordMask;
+
+				if (bits != 0)
+					return (word * OccupancyBitsPerWord) + HighestSetBitIndex(bits);
+			}
+		}
+
+		return -1;
 	}
 
-	static b8 FitsInsideTexture(const ivec4& textureBox, const std::vector<SprMarkupBox>& existingSprites, const ivec4& spriteBox)
+	static b8 FitsInsideTexture(const ivec4& textureBox, const SprTexOccupancy& occupancy, const ivec4& spriteBox)
 	{
 		if (!Contains(textureBox, spriteBox))
 			return false;
 
-		for (const auto& existingSprite : existingSprites)
+		return (FindOccupiedColumn(occupancy, spriteBox) < 0);
+	}
+
+	static void SplitFreeRectsAroundBox(std::vector<ivec4>& inOutFreeRects, const ivec4& usedBox)
+	{
+		// NOTE: Every free rect touched by the used box is replaced by up to four maximal sub rects surrounding it
+		const size_t oldFreeRectCount = inOutFreeRects.size();
+		size_t keptFreeRectCount = 0;
+		std::vector<ivec4> newFreeRects;
+
+		for (size_t i = 0; i < oldFreeRectCount; i++)
 		{
-			if (Intersects(existingSprite.Box, spriteBox))
-				return false;
+			const ivec4 freeRect = inOutFreeRects[i];
+			if (!Intersects(freeRect, usedBox))
+			{
+				inOutFreeRects[keptFreeRectCount++] = freeRect;
+				continue;
+			}
+
+			if (usedBox.x > freeRect.x)
+				newFreeRects.push_back(ivec4(freeRect.x, freeRect.y, usedBox.x - freeRect.x, freeRect.w));
+			if (GetBoxRight(usedBox) < GetBoxRight(freeRect))
+				newFreeRects.push_back(ivec4(GetBoxRight(usedBox), freeRect.y, GetBoxRight(freeRect) - GetBoxRight(usedBox), freeRect.w));
+			if (usedBox.y > freeRect.y)
+				newFreeRects.push_back(ivec4(freeRect.x, freeRect.y, freeRect.z, usedBox.y - freeRect.y));
+			if (GetBoxBottom(usedBox) < GetBoxBottom(freeRect))
+				newFreeRects.push_back(ivec4(freeRect.x, GetBoxBottom(usedBox), freeRect.z, GetBoxBottom(freeRect) - GetBoxBottom(usedBox)));
 		}
 
-		return true;
+		inOutFreeRects.resize(keptFreeRectCount);
+
+		// NOTE: The kept rects were already free of redundancy so only the newly split ones need to be pruned,
+		//		 none of the kept rects can be contained by a new one because each new one is a subset of a previous free rect
+		for (size_t i = 0; i < newFreeRects.size(); i++)
+		{
+			const ivec4& newRect = newFreeRects[i];
+			b8 isRedundant = false;
+
+			for (size_t j = 0; j < keptFreeRectCount && !isRedundant; j++)
+				isRedundant = Contains(inOutFreeRects[j], newRect);
+
+			for (size_t j = 0; j < newFreeRects.size() && !isRedundant; j++)
+			{
+				if (i == j || !Contains(newFreeRects[j], newRect))
+					continue;
+
+				// NOTE: Of two identical rects only keep the first one
+				const ivec4& otherRect = newFreeRects[j];
+				const b8 isIdentical = (otherRect.x == newRect.x && otherRect.y == newRect.y && otherRect.z == newRect.z && otherRect.w == newRect.w);
+				isRedundant = !isIdentical || (j < i);
+			}
+
+			if (!isRedundant)
+				inOutFreeRects.push_back(newRect);
+		}
 	}
 
 	static constexpr vec4 GetTexelRegionFromPixelRegion(const vec4& spritePixelRegion, vec2 textureAtlasSize)
@@ -762,126 +2284,293 @@ namespace Comfy
 		return reinterpret_cast<const u32*>(rgbaPixels)[(width * y) + x];
 	}
 
-	static void CopySprIntoTex(const SprTexMarkup& texMarkup, void* texData, const SprMarkupBox& sprBox)
+	// NOTE: Blocks until the pixels of a sprite that is still being decoded are available
+	static const void* GetSprRGBAPixels(const SprMarkup& sprMarkup)
 	{
-		const auto texSize = texMarkup.Size;
+		if (sprMarkup.RGBAPixels == nullptr && sprMarkup.PendingRGBAPixels.valid())
+			return sprMarkup.PendingRGBAPixels.get();
+		return sprMarkup.RGBAPixels;
+	}
 
-		const auto sprSize = sprBox.Markup->Size;
-		const auto sprBoxSize = GetBoxSize(sprBox.Box);
+	// NOTE: Lazily loaded sprites are decoded again every time and freed as soon as this goes out of scope, all others are simply referenced
+	class ScopedSprRGBAPixels
+	{
+	public:
+		explicit ScopedSprRGBAPixels(const SprMarkup& sprMarkup)
+		{
+			if (!sprMarkup.LoadRGBAPixels)
+			{
+				rgbaPixels = GetSprRGBAPixels(sprMarkup);
+				return;
+			}
+
+			loadedPixels = sprMarkup.LoadRGBAPixels();
+			if (loadedPixels == nullptr)
+				placeholderPixels = std::make_unique<u8[]>(Area(sprMarkup.Size) * RGBABytesPerPixel);
+
+			rgbaPixels = (loadedPixels != nullptr) ? static_cast<const void*>(loadedPixels.get()) : placeholderPixels.get();
+		}
+
+		const void* Get() const { return rgbaPixels; }
+
+	private:
+		DecodedImagePixels loadedPixels;
+		std::unique_ptr<u8[]> placeholderPixels;
+		const void* rgbaPixels = nullptr;
+	};
+
+	static constexpr ivec2 GetSprSizeInTex(const SprMarkupBox& sprBox)
+	{
+		return sprBox.Rotated ? ivec2(sprBox.Markup->Size.y, sprBox.Markup->Size.x) : sprBox.Markup->Size;
+	}
 
+	// NOTE: Writes a single row of a sprite box including its clamp-to-edge padding, the texture row is expected to start at the left edge of the box
+	static void CopySprRowIntoTexRow(const SprMarkupBox& sprBox, i32 boxRow, u32* texRow)
+	{
+		const auto sprSize = GetSprSizeInTex(sprBox);
+		const auto sprBoxSize = GetBoxSize(sprBox.Box);
 		const auto sprPadding = (sprBoxSize - sprSize) / 2;
-		const auto sprOffset = GetBoxPos(sprBox.Box) + sprPadding;
 
-		const void* sprData = sprBox.Markup->RGBAPixels;
+		if (sprSize.x <= 0 || sprSize.y <= 0)
+			return;
+
+		const b8 writePadding = (sprPadding.x > 0 && sprPadding.y > 0);
+		const b8 isPaddingRow = (boxRow < sprPadding.y || boxRow >= (sprPadding.y + sprSize.y));
+
+		if (isPaddingRow && !writePadding)
+			return;
+
+		const i32 sprRow = Clamp(boxRow - sprPadding.y, 0, sprSize.y - 1);
+
+		const u32* sprData = reinterpret_cast<const u32*>(GetSprRGBAPixels(*sprBox.Markup));
+		const i32 sprDataWidth = sprBox.Markup->Size.x;
+
+		u32* texSprRow = texRow + sprPadding.x;
 
-		if (sprPadding.x > 0 && sprPadding.y > 0 && sprSize.x > 0 && sprSize.y > 0)
+		// NOTE: Sample in texture orientation, rotated sprites are stored turned 90 degrees clockwise
+		if (sprBox.Rotated)
 		{
-			const auto cornerTopLeft = GetBoxPos(sprBox.Box);
-			const auto cornerBottomRight = cornerTopLeft + sprBoxSize - sprPadding;
+			for (i32 x = 0; x < sprSize.x; x++)
+				texSprRow[x] = sprData[(sprDataWidth * (sprSize.x - 1 - x)) + sprRow];
+		}
+		else
+		{
+			std::memcpy(texSprRow, &sprData[sprDataWidth * sprRow], sprSize.x * sizeof(u32));
+		}
+
+		if (writePadding)
+		{
+			// NOTE: Left / right
 			for (i32 x = 0; x < sprPadding.x; x++)
-			{
-				for (i32 y = 0; y < sprPadding.y; y++)
-				{
-					const auto topLeft = cornerTopLeft + ivec2(x, y);
-					const auto bottomRight = cornerBottomRight + ivec2(x, y);
-
-					// NOTE: Top left / bottom left / top right / bottom right
-					GetPixel(texSize.x, texData, topLeft.x, topLeft.y) = GetPixel(sprSize.x, sprData, 0, 0);
-					GetPixel(texSize.x, texData, topLeft.x, bottomRight.y) = GetPixel(sprSize.x, sprData, 0, sprSize.y - 1);
-					GetPixel(texSize.x, texData, bottomRight.x, topLeft.y) = GetPixel(sprSize.x, sprData, sprSize.x - 1, 0);
-					GetPixel(texSize.x, texData, bottomRight.x, bottomRight.y) = GetPixel(sprSize.x, sprData, sprSize.x - 1, sprSize.y - 1);
-				}
-			}
+				texRow[x] = texSprRow[0];
+			for (i32 x = sprPadding.x + sprSize.x; x < sprBoxSize.x; x++)
+				texRow[x] = texSprRow[sprSize.x - 1];
+		}
+	}
 
-			// NOTE: Top / bottom / left / right
-			for (i32 x = sprPadding.x; x < sprBoxSize.x - sprPadding.x; x++)
-			{
-				for (i32 y = 0; y < sprPadding.y; y++)
-					GetPixel(texSize.x, texData, x + sprBox.Box.x, y + sprBox.Box.y) = GetPixel(sprSize.x, sprData, x - sprPadding.x, 0);
-				for (i32 y = sprBoxSize.y - sprPadding.y; y < sprBoxSize.y; y++)
-					GetPixel(texSize.x, texData, x + sprBox.Box.x, y + sprBox.Box.y) = GetPixel(sprSize.x, sprData, x - sprPadding.x, sprSize.y - 1);
-			}
-			for (i32 y = sprPadding.y; y < sprBoxSize.y - sprPadding.y; y++)
-			{
-				for (i32 x = 0; x < sprPadding.x; x++)
-					GetPixel(texSize.x, texData, x + sprBox.Box.x, y + sprBox.Box.y) = GetPixel(sprSize.x, sprData, 0, y - sprPadding.y);
-				for (i32 x = sprBoxSize.x - sprPadding.x; x < sprBoxSize.x; x++)
-					GetPixel(texSize.x, texData, x + sprBox.Box.x, y + sprBox.Box.y) = GetPixel(sprSize.x, sprData, sprSize.x - 1, y - sprPadding.y);
-			}
+	static void SetPixelsUniformTransparency(i32 pixelCount, u32* rgbaPixels, u32 transparencyColor)
+	{
+		for (i32 i = 0; i < pixelCount; i++)
+		{
+			u32& pixel = rgbaPixels[i];
+			const b8 isFullyTransparent = ((pixel >> 24) & 0xFF) == 0x00;
+
+			if (isFullyTransparent)
+				pixel = transparencyColor;
 		}
+	}
+
+	// NOTE: Which channels of a sprite actually carry information.
+	//		 Fully transparent pixels are ignored by the color checks as their color is never visible
+	struct SprChannelUsage
+	{
+		// NOTE: Every alpha value is 255
+		b8 Opaque;
+		// NOTE: Every alpha value is either 0 or 255
+		b8 BinaryAlpha;
+		// NOTE: R, G and B are equal for every visible pixel
+		b8 Grayscale;
+		// NOTE: Every visible pixel is white so only the alpha channel matters
+		b8 WhiteColor;
+	};
 
-		for (i32 y = 0; y < sprSize.y; y++)
+	// NOTE: Reduced over all pixels, each flag stays set for as long as every pixel satisfies it
+	struct ChannelUsageAccumulator
+	{
+		u32 AllBitsAnd = 0xFFFFFFFF;
+		b8 BinaryAlpha = true;
+		b8 Grayscale = true;
+		b8 WhiteColor = true;
+
+		b8 CanStillChange() const { return ((AllBitsAnd >> 24) == 0xFF) || BinaryAlpha || Grayscale || WhiteColor; }
+	};
+
+	static void AccumulateChannelUsageScalar(const u32* pixels, size_t pixelCount, ChannelUsageAccumulator& inOutUsage)
+	{
+		for (size_t i = 0; i < pixelCount; i++)
 		{
-			for (i32 x = 0; x < sprSize.x; x++)
-			{
-				const u32& sprPixel = GetPixel(sprSize.x, sprData, x, y);
-				u32& texPixel = GetPixel(texSize.x, texData, x + sprOffset.x, y + sprOffset.y);
+			const u32 pixel = pixels[i];
+			const u32 alpha = (pixel >> 24);
+			const b8 isVisible = (alpha != 0x00);
+
+			inOutUsage.AllBitsAnd &= pixel;
+			inOutUsage.BinaryAlpha &= (alpha == 0x00 || alpha == 0xFF);
+			inOutUsage.Grayscale &= (!isVisible || (pixel & 0xFFFF) == ((pixel >> 8) & 0xFFFF));
+			inOutUsage.WhiteColor &= (!isVisible || (pixel & 0x00FFFFFF) == 0x00FFFFFF);
+		}
+	}
 
-				texPixel = sprPixel;
-			}
+#if COMFY_TEXTURE_UTIL_SIMD
+	// NOTE: Only needs SSE2 but is dispatched together with the other SSE4.1 kernels, the scan is memory bound so there is no separate AVX2 version
+	static void AccumulateChannelUsageSSE(const u32* pixels, size_t pixelCount, ChannelUsageAccumulator& inOutUsage)
+	{
+		const size_t simdPixelCount = (pixelCount & ~static_cast<size_t>(3));
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alphaMax = _mm_set1_epi32(0xFF);
+		const __m128i lowerTwoChannelsMask = _mm_set1_epi32(0xFFFF);
+		const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+
+		__m128i allBitsAnd = _mm_set1_epi32(-1), binaryAlpha = _mm_set1_epi32(-1), grayscale = _mm_set1_epi32(-1), whiteColor = _mm_set1_epi32(-1);
+		for (size_t i = 0; i < simdPixelCount; i += 4)
+		{
+			const __m128i pixel = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&pixels[i]));
+			const __m128i alpha = _mm_srli_epi32(pixel, 24);
+			const __m128i isInvisible = _mm_cmpeq_epi32(alpha, zero);
+
+			// NOTE: Comparing GR against BG checks both R == G and G == B at once
+			const __m128i isGrayscale = _mm_cmpeq_epi32(_mm_and_si128(pixel, lowerTwoChannelsMask), _mm_and_si128(_mm_srli_epi32(pixel, 8), lowerTwoChannelsMask));
+			const __m128i isWhite = _mm_cmpeq_epi32(_mm_and_si128(pixel, colorMask), colorMask);
+
+			allBitsAnd = _mm_and_si128(allBitsAnd, pixel);
+			binaryAlpha = _mm_and_si128(binaryAlpha, _mm_or_si128(isInvisible, _mm_cmpeq_epi32(alpha, alphaMax)));
+			grayscale = _mm_and_si128(grayscale, _mm_or_si128(isInvisible, isGrayscale));
+			whiteColor = _mm_and_si128(whiteColor, _mm_or_si128(isInvisible, isWhite));
 		}
+
+		alignas(16) u32 allBitsAndLanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(allBitsAndLanes), allBitsAnd);
+
+		inOutUsage.AllBitsAnd &= (allBitsAndLanes[0] & allBitsAndLanes[1] & allBitsAndLanes[2] & allBitsAndLanes[3]);
+		inOutUsage.BinaryAlpha &= (_mm_movemask_epi8(binaryAlpha) == 0xFFFF);
+		inOutUsage.Grayscale &= (_mm_movemask_epi8(grayscale) == 0xFFFF);
+		inOutUsage.WhiteColor &= (_mm_movemask_epi8(whiteColor) == 0xFFFF);
+
+		AccumulateChannelUsageScalar(&pixels[simdPixelCount], pixelCount - simdPixelCount, inOutUsage);
 	}
+#endif /* COMFY_TEXTURE_UTIL_SIMD */
 
-	static void SetPixelsUniformTransparency(ivec2 size, void* rgbaPixels, u32 transparencyColor)
+	static SprChannelUsage AnalyzeSprChannelUsage(const SprMarkup& sprMarkup)
 	{
-		for (i32 y = 0; y < size.y; y++)
+		const ScopedSprRGBAPixels rgbaPixels(sprMarkup);
+		const u32* pixels = static_cast<const u32*>(rgbaPixels.Get());
+		const size_t pixelCount = static_cast<size_t>(Area(sprMarkup.Size));
+
+		// NOTE: Scanned in chunks to stop early once a sprite is known to need every channel
+		constexpr size_t chunkPixelCount = 4096;
+		const b8 useSimd = (GetActiveSimdLevel() >= SimdLevel::SSE41);
+
+		ChannelUsageAccumulator usage;
+		for (size_t i = 0; i < pixelCount && usage.CanStillChange(); i += chunkPixelCount)
 		{
-			for (i32 x = 0; x < size.x; x++)
+			const size_t count = Min(chunkPixelCount, pixelCount - i);
+#if COMFY_TEXTURE_UTIL_SIMD
+			if (useSimd)
 			{
-				u32& pixel = GetPixel(size.x, rgbaPixels, x, y);
-				const b8 isFullyTransparent = ((pixel >> 24) & 0xFF) == 0x00;
-
-				if (isFullyTransparent)
-					pixel = transparencyColor;
+				AccumulateChannelUsageSSE(&pixels[i], count, usage);
+				continue;
 			}
+#endif
+			AccumulateChannelUsageScalar(&pixels[i], count, usage);
 		}
+
+		SprChannelUsage result;
+		result.Opaque = ((usage.AllBitsAnd >> 24) == 0xFF);
+		result.BinaryAlpha = usage.BinaryAlpha;
+		result.Grayscale = usage.Grayscale;
+		result.WhiteColor = usage.WhiteColor;
+		return result;
 	}
 
-	static void FlipTextureY(ivec2 size, void* rgbaPixels)
+	// NOTE: Plain channel extraction for the uncompressed single channel formats, the channel analysis has already made sure that nothing visible is lost
+	static std::unique_ptr<u8[]> ExtractRGBAChannels(ivec2 size, const u8* rgbaPixels, TextureFormat outFormat)
 	{
-		for (i32 y = 0; y < size.y / 2; y++)
+		const size_t pixelCount = static_cast<size_t>(size.x) * size.y;
+		auto outData = std::make_unique<u8[]>(TextureFormatByteSize(size, outFormat));
+
+		for (size_t i = 0; i < pixelCount; i++)
 		{
-			for (i32 x = 0; x < size.x; x++)
+			const u8* rgba = &rgbaPixels[i * RGBABytesPerPixel];
+			switch (outFormat)
 			{
-				u32& pixel = GetPixel(size.x, rgbaPixels, x, y);
-				u32& flippedPixel = GetPixel(size.x, rgbaPixels, x, size.y - 1 - y);
-
-				std::swap(pixel, flippedPixel);
+			case TextureFormat::A8: outData[i] = rgba[3]; break;
+			case TextureFormat::L8: outData[i] = rgba[0]; break;
+			case TextureFormat::L8A8: outData[i * 2 + 0] = rgba[0]; outData[i * 2 + 1] = rgba[3]; break;
+			default: assert(false); break;
 			}
 		}
+
+		return outData;
 	}
 
-	static constexpr b8 MakesUseOfAlphaChannel(const SprMarkup& sprMarkup)
+	// NOTE: Peak signal to noise ratio in decibels over all four channels. The color of fully transparent reference pixels is never visible
+	//		 and block encoders are free to discard it, so only their alpha channel is taken into account.
+	//		 Formats without an alpha channel are only used for opaque sprites and skip the transparent background entirely
+	static f64 CalculateRGBAPSNR(ivec2 size, const u8* referencePixels, const u8* decodedPixels, b8 compareAlpha)
 	{
-		for (i32 y = 0; y < sprMarkup.Size.y; y++)
+		const size_t pixelCount = static_cast<size_t>(size.x) * size.y;
+
+		u64 squaredErrorSum = 0, sampleCount = 0;
+		for (size_t i = 0; i < pixelCount; i++)
 		{
-			for (i32 x = 0; x < sprMarkup.Size.x; x++)
-			{
-				constexpr u32 alphaMask = 0xFF000000;
-				const u32 pixel = GetPixel(sprMarkup.Size.x, sprMarkup.RGBAPixels, x, y);
+			const u8* reference = &referencePixels[i * RGBABytesPerPixel];
+			const u8* decoded = &decodedPixels[i * RGBABytesPerPixel];
+
+			if (reference[3] == 0x00 && !compareAlpha)
+				continue;
 
-				if ((pixel & alphaMask) != alphaMask)
-					return true;
+			const size_t firstChannel = (reference[3] == 0x00) ? 3 : 0;
+			const size_t endChannel = compareAlpha ? RGBABytesPerPixel : 3;
+			for (size_t c = firstChannel; c < endChannel; c++)
+			{
+				const i32 difference = static_cast<i32>(reference[c]) - static_cast<i32>(decoded[c]);
+				squaredErrorSum += static_cast<u64>(difference * difference);
 			}
+			sampleCount += (endChannel - firstChannel);
 		}
 
-		return false;
+		if (squaredErrorSum == 0 || sampleCount == 0)
+			return std::numeric_limits<f64>::infinity();
+
+		const f64 meanSquaredError = static_cast<f64>(squaredErrorSum) / static_cast<f64>(sampleCount);
+		return 10.0 * std::log10((255.0 * 255.0) / meanSquaredError);
 	}
 
-	std::unique_ptr<SprSet> SprPacker::Create(const std::vector<SprMarkup>& sprMarkups)
+	std::unique_ptr<SprSet> SprPacker::Create(const std::vector<SprMarkup>& inSprMarkups)
 	{
 		currentProgress = {};
+		currentProgress.TextureIndex = -1;
+		createStopwatch = CPUStopwatch::StartNew();
+
+		Statistics = {};
+
+		std::vector<std::vector<const SprMarkup*>> duplicateSprMarkups;
+		const auto sprMarkups = Settings.MergeDuplicateSprites ? RemoveDuplicateSprMarkups(inSprMarkups, duplicateSprMarkups) : inSprMarkups;
 
 		auto result = std::make_unique<SprSet>();
 		SprSet& sprSet = *result;
 
 		sprSet.Flags = 0;
-		sprSet.Sprites.reserve(sprMarkups.size());
+		sprSet.Sprites.reserve(inSprMarkups.size());
 
+		auto layoutStopwatch = CPUStopwatch::StartNew();
 		const auto mergedTextures = MergeTextures(sprMarkups);
+		Statistics.LayoutTime = layoutStopwatch.Stop();
+
+		currentProgress.TexturesTotal = static_cast<u32>(mergedTextures.size());
 
-		std::vector<std::future<std::shared_ptr<Tex>>> texFutures;
-		texFutures.reserve(mergedTextures.size());
+		std::vector<ThreadPool::Task<std::shared_ptr<Tex>>> texTasks;
+		texTasks.reserve(mergedTextures.size());
 
 		for (size_t texIndex = 0; texIndex < mergedTextures.size(); texIndex++)
 		{
@@ -889,83 +2578,463 @@ namespace Comfy
 			for (const auto& sprBox : texMarkup.SpriteBoxes)
 			{
 				const auto& sprMarkup = *sprBox.Markup;
-				const auto sprPadding = (GetBoxSize(sprBox.Box) - sprMarkup.Size) / 2;
-
-				auto& spr = sprSet.Sprites.emplace_back();
-				spr.TextureIndex = static_cast<i32>(texIndex);
-				spr.Rotate = 0;
-				spr.PixelRegion = vec4(ivec4(GetBoxPos(sprBox.Box) + sprPadding, sprMarkup.Size));
-				spr.TexelRegion = GetTexelRegionFromPixelRegion(spr.PixelRegion, vec2(texMarkup.Size));
-				spr.Name = sprMarkup.Name;
-				spr.Extra.Flags = 0;
-				spr.Extra.ScreenMode = sprMarkup.ScreenMode;
+				const auto sprTexSize = GetSprSizeInTex(sprBox);
+				const auto sprPadding = (GetBoxSize(sprBox.Box) - sprTexSize) / 2;
+
+				// NOTE: The pixel region keeps the unrotated sprite size while the texel region covers the rotated area inside the texture
+				auto addSpr = [&](const SprMarkup& namedSprMarkup)
+				{
+					auto& spr = sprSet.Sprites.emplace_back();
+					spr.TextureIndex = static_cast<i32>(texIndex);
+					spr.Rotate = sprBox.Rotated ? 1 : 0;
+					spr.PixelRegion = vec4(ivec4(GetBoxPos(sprBox.Box) + sprPadding, sprMarkup.Size));
+					spr.TexelRegion = GetTexelRegionFromPixelRegion(vec4(ivec4(GetBoxPos(sprBox.Box) + sprPadding, sprTexSize)), vec2(texMarkup.Size));
+					spr.Name = namedSprMarkup.Name;
+					spr.Extra.Flags = 0;
+					spr.Extra.ScreenMode = namedSprMarkup.ScreenMode;
+				};
+
+				addSpr(sprMarkup);
+
+				// NOTE: Identical sprites all share the texture region of the one that was actually packed
+				if (!duplicateSprMarkups.empty())
+				{
+					for (const auto* duplicateSprMarkup : duplicateSprMarkups[ArrayItToIndex(&sprMarkup, sprMarkups.data())])
+						addSpr(*duplicateSprMarkup);
+				}
 			}
 
-			texFutures.emplace_back(std::async(Settings.Multithreaded ? std::launch::async : std::launch::deferred, [&texMarkup, this]
+			texTasks.push_back(ThreadPool::GetShared().Submit(Settings.Multithreaded, [&texMarkup, texIndex, this]
 			{
-				return CreateCompressTexFromMarkup(texMarkup);
+				return CreateLazyLoadedCompressTexFromMarkup(texMarkup, texIndex);
 			}));
 		}
 
 		FinalSpriteSort(sprSet.Sprites);
 
 		sprSet.TexSet.Textures.reserve(mergedTextures.size());
-		for (auto& texFuture : texFutures)
-			sprSet.TexSet.Textures.emplace_back(std::move(texFuture.get()));
+		for (auto& texTask : texTasks)
+			sprSet.TexSet.Textures.emplace_back(texTask.Get());
+
+		// NOTE: The quality budget may have settled on a different compression type than the one the textures were laid out for
+		if (Settings.CompressionQualityTarget.has_value())
+		{
+			std::array<std::array<u16, EnumCount<SprCompressionType>>, EnumCount<SprMergeType>> formatTypeIndices = {};
+			for (size_t texIndex = 0; texIndex < mergedTextures.size(); texIndex++)
+			{
+				auto& tex = *sprSet.TexSet.Textures[texIndex];
+				const auto merge = mergedTextures[texIndex].Merge;
+				const auto compression = GetCompressionType(tex.GetFormat());
+
+				auto& formatTypeIndex = formatTypeIndices[static_cast<size_t>(merge)][static_cast<size_t>(compression)];
+				tex.Name = FormatTextureName(merge, compression, formatTypeIndex++);
+			}
+		}
+
+		return result;
+	}
+
+	static u64 HashRGBAPixels(ivec2 size, const void* rgbaPixels)
+	{
+		// NOTE: FNV-1a over whole pixels, collisions are resolved by comparing the actual pixel data
+		u64 hash = 0xCBF29CE484222325;
+		for (i32 i = 0; i < Area(size); i++)
+		{
+			hash ^= reinterpret_cast<const u32*>(rgbaPixels)[i];
+			hash *= 0x00000100000001B3;
+		}
+		return hash;
+	}
+
+	std::vector<SprMarkup> SprPacker::RemoveDuplicateSprMarkups(const std::vector<SprMarkup>& sprMarkups, std::vector<std::vector<const SprMarkup*>>& outDuplicates)
+	{
+		std::vector<SprMarkup> result;
+		result.reserve(sprMarkups.size());
+
+		std::vector<size_t> originalIndices;
+		originalIndices.reserve(sprMarkups.size());
+
+		// NOTE: Only sprites sharing their size and flags with another sprite can possibly be duplicates, so none of the others have to be hashed
+		//		 or waited on if their pixels are still being decoded. Colliding keys only cause some unnecessary hashing
+		auto getSizeFlagsKey = [](const SprMarkup& sprMarkup)
+		{
+			return (static_cast<u64>(static_cast<u32>(sprMarkup.Size.x)) << 32) ^ (static_cast<u64>(static_cast<u32>(sprMarkup.Size.y)) << 8) ^ sprMarkup.Flags;
+		};
+
+		std::unordered_map<u64, u32> sizeFlagsKeyCounts;
+		for (const auto& sprMarkup : sprMarkups)
+			sizeFlagsKeyCounts[getSizeFlagsKey(sprMarkup)]++;
+
+		std::unordered_multimap<u64, size_t> uniqueIndicesByHash;
+		outDuplicates.clear();
+		outDuplicates.reserve(sprMarkups.size());
+
+		for (size_t i = 0; i < sprMarkups.size(); i++)
+		{
+			const auto& sprMarkup = sprMarkups[i];
+
+			std::optional<ScopedSprRGBAPixels> scopedPixels;
+			if (sizeFlagsKeyCounts[getSizeFlagsKey(sprMarkup)] > 1)
+				scopedPixels.emplace(sprMarkup);
+			const void* rgbaPixels = scopedPixels.has_value() ? scopedPixels->Get() : nullptr;
+
+			const u64 hash = (rgbaPixels != nullptr) ? HashRGBAPixels(sprMarkup.Size, rgbaPixels) : 0;
+			const auto[hashBegin, hashEnd] = uniqueIndicesByHash.equal_range(hash);
+
+			// NOTE: Sprites with different flags might end up with different output formats so they can't share a texture region
+			auto matchingUnique = (rgbaPixels == nullptr) ? hashEnd : std::find_if(hashBegin, hashEnd, [&](const auto& hashIndexPair)
+			{
+				const auto& uniqueSprMarkup = sprMarkups[originalIndices[hashIndexPair.second]];
+				if (uniqueSprMarkup.Size != sprMarkup.Size || uniqueSprMarkup.Flags != sprMarkup.Flags)
+					return false;
+
+				const ScopedSprRGBAPixels uniquePixels(uniqueSprMarkup);
+				return (uniquePixels.Get() != nullptr) && std::memcmp(uniquePixels.Get(), rgbaPixels, Area(sprMarkup.Size) * RGBABytesPerPixel) == 0;
+			});
+
+			if (matchingUnique != hashEnd)
+			{
+				outDuplicates[matchingUnique->second].push_back(&sprMarkup);
+				Statistics.DuplicateSprites++;
+				Statistics.DuplicateSpriteBytes += Area(sprMarkup.Size) * RGBABytesPerPixel;
+				continue;
+			}
+
+			uniqueIndicesByHash.emplace(hash, result.size());
+			originalIndices.push_back(i);
+			outDuplicates.emplace_back();
+			result.push_back(sprMarkup);
+		}
 
 		return result;
 	}
 
 	void SprPacker::ReportCurrentProgress()
 	{
+		currentProgress.Elapsed = createStopwatch.GetElapsed();
+
 		if (progressCallback)
 			progressCallback(*this, currentProgress);
 	}
 
+	void SprPacker::AdvanceProgressSprites(u32 sprites)
+	{
+		const auto lock = std::scoped_lock(progressMutex);
+		currentProgress.Phase = SprPackerPhase::Layout;
+		currentProgress.Sprites += sprites;
+		ReportCurrentProgress();
+	}
+
+	void SprPacker::AdvanceProgressTexture(SprPackerPhase phase, size_t texIndex, Time phaseTime)
+	{
+		const auto lock = std::scoped_lock(progressMutex);
+		currentProgress.Phase = phase;
+		currentProgress.TextureIndex = static_cast<i32>(texIndex);
+		currentProgress.PhaseTime = phaseTime;
+
+		// NOTE: A texture is only considered done once it has been compressed
+		if (phase == SprPackerPhase::Compress)
+			currentProgress.Textures++;
+
+		ReportCurrentProgress();
+	}
+
+	static SprChannelUsage GetSprHeaderChannelUsage(const SprMarkup& sprMarkup)
+	{
+		SprChannelUsage result;
+		result.Opaque = (sprMarkup.Flags & SprMarkupFlags_HeaderOpaque);
+		result.BinaryAlpha = result.Opaque;
+		result.Grayscale = (sprMarkup.Flags & SprMarkupFlags_HeaderGrayscale);
+		result.WhiteColor = false;
+		return result;
+	}
+
+	b8 SprPacker::IsSprOutputUncompressed(const SprMarkup& sprMarkup) const
+	{
+		return !(sprMarkup.Flags & SprMarkupFlags_Compress) ||
+			((sprMarkup.Flags & SprMarkupFlags_NoMerge) && Area(sprMarkup.Size) <= Settings.NoMergeUncompressedAreaThreshold);
+	}
+
+	b8 SprPacker::DoesSprOutputFormatDependOnPixels(const SprMarkup& sprMarkup) const
+	{
+		// NOTE: Without single channel formats uncompressed sprites are always RGBA8 and compressed ones always RGTC2 once YCbCr is allowed
+		if (Settings.AllowSingleChannelTextures)
+			return true;
+
+		return !IsSprOutputUncompressed(sprMarkup) && !Settings.AllowYCbCrTextures;
+	}
+
 	TextureFormat SprPacker::DetermineSprOutputFormat(const SprMarkup& sprMarkup) const
 	{
-		if (!(sprMarkup.Flags & SprMarkupFlags_Compress))
-			return TextureFormat::RGBA8;
+		const b8 uncompressed = IsSprOutputUncompressed(sprMarkup);
+
+		// NOTE: Skips the pixel analysis whenever it couldn't change the result, which for lazily loaded sprites would mean decoding them again
+		if (!DoesSprOutputFormatDependOnPixels(sprMarkup))
+			return uncompressed ? TextureFormat::RGBA8 : TextureFormat::RGTC2;
+
+		const auto channelUsage = (sprMarkup.Flags & SprMarkupFlags_HeaderChannelHints) ? GetSprHeaderChannelUsage(sprMarkup) : AnalyzeSprChannelUsage(sprMarkup);
+		if (uncompressed)
+		{
+			if (Settings.AllowSingleChannelTextures)
+			{
+				if (channelUsage.WhiteColor && !channelUsage.Opaque)
+					return TextureFormat::A8;
+
+				if (channelUsage.Grayscale)
+					return channelUsage.Opaque ? TextureFormat::L8 : TextureFormat::L8A8;
+			}
 
-		if ((sprMarkup.Flags & SprMarkupFlags_NoMerge) && Area(sprMarkup.Size) <= Settings.NoMergeUncompressedAreaThreshold)
 			return TextureFormat::RGBA8;
+		}
+
+		// NOTE: Same size as DXT1 but a single BC4 channel keeps considerably more gray levels
+		if (Settings.AllowSingleChannelTextures && channelUsage.Grayscale && channelUsage.Opaque)
+			return TextureFormat::RGTC1;
+
+		if (Settings.AllowYCbCrTextures)
+			return TextureFormat::RGTC2;
+
+		if (channelUsage.Opaque)
+			return TextureFormat::DXT1;
+
+		// NOTE: Half the size of DXT5, sprites with cut out edges lose nothing with BC1s punch-through alpha
+		if (Settings.AllowPunchThroughAlphaTextures && channelUsage.BinaryAlpha)
+			return TextureFormat::DXT1a;
+
+		return TextureFormat::DXT5;
+	}
+
+	std::vector<SprTexMarkup> SprPacker::MergeTextures(const std::vector<SprMarkup>& sprMarkups)
+	{
+		std::vector<TextureFormat> sprOutputFormats(sprMarkups.size());
+
+		// NOTE: The channel analysis itself is memory bound but lazily loaded sprites first have to be decoded again, which is worth spreading across threads.
+		//		 Each worker only ever holds on to a single sprite at a time
+		const b8 decodesSprPixels = std::any_of(sprMarkups.begin(), sprMarkups.end(), [this](const SprMarkup& sprMarkup)
+		{
+			return sprMarkup.LoadRGBAPixels && !(sprMarkup.Flags & SprMarkupFlags_HeaderChannelHints) && DoesSprOutputFormatDependOnPixels(sprMarkup);
+		});
+
+		std::atomic<size_t> nextSprIndex = 0;
+		auto determineSprOutputFormats = [&]
+		{
+			for (size_t i = nextSprIndex++; i < sprMarkups.size(); i = nextSprIndex++)
+				sprOutputFormats[i] = DetermineSprOutputFormat(sprMarkups[i]);
+		};
+
+		const size_t workerCount = (Settings.Multithreaded && decodesSprPixels) ? Clamp<size_t>(ThreadPool::GetShared().GetWorkerCount(), 1, Max<size_t>(sprMarkups.size(), 1)) : 1;
+		std::vector<ThreadPool::Task<void>> workerTasks;
+		workerTasks.reserve(workerCount - 1);
+
+		for (size_t i = 1; i < workerCount; i++)
+			workerTasks.push_back(ThreadPool::GetShared().Submit(true, determineSprOutputFormats));
+
+		determineSprOutputFormats();
+		for (auto& workerTask : workerTasks)
+			workerTask.Get();
+
+		if (!Settings.OptimizePacking)
+		{
+			currentProgress.Sprites = 0;
+			currentProgress.SpritesTotal = static_cast<u32>(sprMarkups.size());
+
+			return MergeTexturesUsing(sprMarkups, sprOutputFormats, SprPackingOrder::Area, Settings.PackingStrategy);
+		}
+
+		constexpr size_t candidateCount = (EnumCount<SprPackingOrder> * EnumCount<SprPackingStrategy>);
+
+		currentProgress.Sprites = 0;
+		currentProgress.SpritesTotal = static_cast<u32>(sprMarkups.size() * candidateCount);
+
+		std::array<ThreadPool::Task<std::vector<SprTexMarkup>>, candidateCount> candidateTasks;
+		for (size_t candidateIndex = 0; candidateIndex < candidateCount; candidateIndex++)
+		{
+			const auto order = static_cast<SprPackingOrder>(candidateIndex / EnumCount<SprPackingStrategy>);
+			const auto strategy = static_cast<SprPackingStrategy>(candidateIndex % EnumCount<SprPackingStrategy>);
+
+			candidateTasks[candidateIndex] = ThreadPool::GetShared().Submit(Settings.Multithreaded, [this, &sprMarkups, &sprOutputFormats, order, strategy]
+			{
+				return MergeTexturesUsing(sprMarkups, sprOutputFormats, order, strategy);
+			});
+		}
+
+		// NOTE: Smallest total texture area first and fewest textures second, ties keep the earliest candidate to stay deterministic
+		auto getTotalTextureArea = [](const std::vector<SprTexMarkup>& texMarkups)
+		{
+			i64 totalArea = 0;
+			for (const auto& texMarkup : texMarkups)
+				totalArea += static_cast<i64>(texMarkup.Size.x) * static_cast<i64>(texMarkup.Size.y);
+			return totalArea;
+		};
+
+		std::vector<SprTexMarkup> bestTexMarkups = candidateTasks[0].Get();
+		i64 bestTotalArea = getTotalTextureArea(bestTexMarkups);
+
+		for (size_t candidateIndex = 1; candidateIndex < candidateCount; candidateIndex++)
+		{
+			auto texMarkups = candidateTasks[candidateIndex].Get();
+			const i64 totalArea = getTotalTextureArea(texMarkups);
+
+			if (totalArea < bestTotalArea || (totalArea == bestTotalArea && texMarkups.size() < bestTexMarkups.size()))
+			{
+				bestTexMarkups = std::move(texMarkups);
+				bestTotalArea = totalArea;
+			}
+		}
+
+		return bestTexMarkups;
+	}
+
+	std::vector<SprTexMarkup> SprPacker::MergeTexturesUsing(const std::vector<SprMarkup>& sprMarkups, const std::vector<TextureFormat>& sprOutputFormats, SprPackingOrder order, SprPackingStrategy strategy)
+	{
+		const auto sizeSortedSprMarkups = SortByPackingOrder(sprMarkups, order);
+
+		// NOTE: A sprite can only ever be placed inside a texture of its own output format so each of these groups can be packed independently
+		std::array<std::vector<const SprMarkup*>, EnumCount<TextureFormat>> formatGroups;
+		for (const auto* sprMarkupPtr : sizeSortedSprMarkups)
+			formatGroups[static_cast<size_t>(sprOutputFormats[ArrayItToIndex(sprMarkupPtr, sprMarkups.data())])].push_back(sprMarkupPtr);
+
+		std::vector<ThreadPool::Task<std::vector<SprTexMarkup>>> groupTasks;
+		for (size_t formatIndex = 0; formatIndex < formatGroups.size(); formatIndex++)
+		{
+			if (formatGroups[formatIndex].empty())
+				continue;
+
+			groupTasks.push_back(ThreadPool::GetShared().Submit(Settings.Multithreaded, [this, &formatGroups, formatIndex, strategy]
+			{
+				return MergeTexturesOfFormat(formatGroups[formatIndex], static_cast<TextureFormat>(formatIndex), strategy);
+			}));
+		}
+
+		std::vector<SprTexMarkup> texMarkups;
+		for (auto& groupTask : groupTasks)
+		{
+			for (auto& texMarkup : groupTask.Get())
+				texMarkups.push_back(std::move(texMarkup));
+		}
+
+		// NOTE: The first sprite box of each texture is always the one that created it, restoring the size sorted creation order
+		//		 keeps the format type indices identical to packing all sprites serially regardless of how the groups were scheduled
+		std::vector<size_t> sizeSortedIndices(sprMarkups.size());
+		for (size_t i = 0; i < sizeSortedSprMarkups.size(); i++)
+			sizeSortedIndices[ArrayItToIndex(sizeSortedSprMarkups[i], sprMarkups.data())] = i;
+
+		std::sort(texMarkups.begin(), texMarkups.end(), [&](const auto& texA, const auto& texB)
+		{
+			return sizeSortedIndices[ArrayItToIndex(texA.SpriteBoxes.front().Markup, sprMarkups.data())] < sizeSortedIndices[ArrayItToIndex(texB.SpriteBoxes.front().Markup, sprMarkups.data())];
+		});
+
+		std::array<std::array<u16, EnumCount<SprCompressionType>>, EnumCount<SprMergeType>> formatTypeIndices = {};
+		for (auto& texMarkup : texMarkups)
+		{
+			auto& formatTypeIndex = formatTypeIndices[static_cast<size_t>(texMarkup.Merge)][static_cast<size_t>(texMarkup.CompressionType)];
+			texMarkup.FormatTypeIndex = formatTypeIndex++;
+			texMarkup.Name = FormatTextureName(texMarkup.Merge, texMarkup.CompressionType, texMarkup.FormatTypeIndex);
+		}
 
-		if (Settings.AllowYCbCrTextures)
-			return TextureFormat::RGTC2;
+		AdjustTexMarkupSizes(texMarkups);
+		FinalTexMarkupSort(texMarkups);
 
-		return MakesUseOfAlphaChannel(sprMarkup) ? TextureFormat::DXT5 : TextureFormat::DXT1;
+		return texMarkups;
 	}
 
-	std::vector<SprTexMarkup> SprPacker::MergeTextures(const std::vector<SprMarkup>& sprMarkups)
+	static b8 CanBePlacedOnSameGrid(const SprMarkup& sprMarkupA, const SprMarkup& sprMarkupB)
 	{
-		currentProgress.Sprites = 0;
-		currentProgress.SpritesTotal = static_cast<u32>(sprMarkups.size());
+		return (sprMarkupA.Size == sprMarkupB.Size) && !(sprMarkupB.Flags & SprMarkupFlags_NoMerge);
+	}
 
-		const auto sizeSortedSprMarkups = SortByArea(sprMarkups);
+	std::vector<SprTexMarkup> SprPacker::MergeTexturesOfFormat(const std::vector<const SprMarkup*>& sizeSortedSprMarkups, TextureFormat sprOutputFormat, SprPackingStrategy strategy)
+	{
 		std::vector<SprTexMarkup> texMarkups;
 
-		std::array<std::array<u16, EnumCount<SprCompressionType>>, EnumCount<SprMergeType>> formatTypeIndices = {};
+		auto addNewTexMarkup = [&](ivec2 texSize, const auto& sprMarkup, ivec2 sprSize, TextureFormat format, SprMergeType merge)
+		{
+			auto& texMarkup = texMarkups.emplace_back();
+			texMarkup.Size = (Settings.PowerOfTwoTextures) ? RoundToNearestPowerOfTwo(texSize) : texSize;
+			texMarkup.OutputFormat = format;
+			texMarkup.CompressionType = GetCompressionType(format);
+			texMarkup.Merge = merge;
+			texMarkup.SpriteBoxes.push_back({ &sprMarkup, ivec4(ivec2(0, 0), sprSize) });
+			texMarkup.RemainingFreePixels = Area(texMarkup.Size) - Area(sprSize);
+
+			if (strategy == SprPackingStrategy::MaxRects)
+			{
+				texMarkup.FreeRects.push_back(ivec4(ivec2(0, 0), texMarkup.Size));
+				SplitFreeRectsAroundBox(texMarkup.FreeRects, texMarkup.SpriteBoxes.back().Box);
+			}
+			else
+			{
+				InitializeOccupancy(texMarkup.Occupancy, texMarkup.Size);
+				MarkOccupied(texMarkup.Occupancy, texMarkup.SpriteBoxes.back().Box);
+			}
+		};
 
-		for (const auto* sprMarkupPtr : sizeSortedSprMarkups)
+		auto placeSprBox = [&](SprTexMarkup& texMarkup, const SprMarkup& sprMarkup, const ivec4& sprBox, b8 rotated)
+		{
+			texMarkup.SpriteBoxes.push_back({ &sprMarkup, sprBox, rotated });
+			texMarkup.RemainingFreePixels -= Area(GetBoxSize(sprBox));
+
+			if (strategy == SprPackingStrategy::MaxRects)
+				SplitFreeRectsAroundBox(texMarkup.FreeRects, sprBox);
+			else
+				MarkOccupied(texMarkup.Occupancy, sprBox);
+		};
+
+		// NOTE: Fill new textures row by row with equally sized sprites without searching for a free spot for each of them
+		auto placeSprRunOnGrid = [&](size_t runStart, size_t runLength)
 		{
-			auto addNewTexMarkup = [&](ivec2 texSize, const auto& sprMarkup, ivec2 sprSize, TextureFormat format, SprMergeType merge)
+			const ivec2 sprBoxSize = sizeSortedSprMarkups[runStart]->Size + (Settings.SpritePadding * 2);
+
+			SprTexMarkup* gridTexMarkup = nullptr;
+			ivec2 gridCells = {};
+			i32 nextCell = 0;
+
+			for (size_t i = runStart; i < runStart + runLength; i++)
 			{
-				const auto compressionType = GetCompressionType(format);
-				auto& formatTypeIndex = formatTypeIndices[static_cast<size_t>(merge)][static_cast<size_t>(compressionType)];
-
-				auto& texMarkup = texMarkups.emplace_back();
-				texMarkup.Size = (Settings.PowerOfTwoTextures) ? RoundToNearestPowerOfTwo(texSize) : texSize;
-				texMarkup.OutputFormat = format;
-				texMarkup.CompressionType = compressionType;
-				texMarkup.Merge = merge;
-				texMarkup.SpriteBoxes.push_back({ &sprMarkup, ivec4(ivec2(0, 0), sprSize) });
-				texMarkup.FormatTypeIndex = formatTypeIndex++;
-				texMarkup.Name = FormatTextureName(texMarkup.Merge, texMarkup.CompressionType, texMarkup.FormatTypeIndex);
-				texMarkup.RemainingFreePixels = Area(texMarkup.Size) - Area(sprSize);
-			};
+				const auto& sprMarkup = *sizeSortedSprMarkups[i];
+
+				if (gridTexMarkup == nullptr || nextCell >= (gridCells.x * gridCells.y))
+				{
+					addNewTexMarkup(Settings.MaxTextureSize, sprMarkup, sprBoxSize, sprOutputFormat, SprMergeType::Merge);
+					gridTexMarkup = &texMarkups.back();
+					gridCells = Max(gridTexMarkup->Size / sprBoxSize, ivec2(1, 1));
+					nextCell = 1;
+
+					// NOTE: For the last partially filled texture pick the column count that leads to the smallest final texture size
+					const i32 remainingSprCount = static_cast<i32>(runStart + runLength - i);
+					if (remainingSprCount < (gridCells.x * gridCells.y))
+					{
+						i32 bestColumns = gridCells.x, bestArea = std::numeric_limits<i32>::max();
+						for (i32 columns = 1; columns <= gridCells.x; columns++)
+						{
+							const i32 rows = (remainingSprCount + columns - 1) / columns;
+							if (rows > gridCells.y)
+								continue;
+
+							const ivec2 neededSize = ivec2(columns, rows) * sprBoxSize;
+							const i32 area = Area((Settings.PowerOfTwoTextures) ? RoundToNearestPowerOfTwo(neededSize) : neededSize);
+							if (area < bestArea)
+							{
+								bestColumns = columns;
+								bestArea = area;
+							}
+						}
+						gridCells.x = bestColumns;
+					}
+					continue;
+				}
+
+				const ivec2 cellPosition = ivec2(nextCell % gridCells.x, nextCell / gridCells.x) * sprBoxSize;
+				placeSprBox(*gridTexMarkup, sprMarkup, ivec4(cellPosition, sprBoxSize), false);
+				nextCell++;
+			}
+		};
 
-			const auto& sprMarkup = *sprMarkupPtr;
-			const auto sprOutputFormat = DetermineSprOutputFormat(sprMarkup);
+		size_t sprIndex = 0;
+		while (sprIndex < sizeSortedSprMarkups.size())
+		{
+			const auto& sprMarkup = *sizeSortedSprMarkups[sprIndex];
+			size_t placedSprCount = 1;
 
 			if (sprMarkup.Flags & SprMarkupFlags_NoMerge)
 			{
@@ -977,29 +3046,39 @@ namespace Comfy
 			}
 			else
 			{
-				if (const auto[fittingTex, fittingSprBox] = FindFittingTexMarkupToPlaceSprIn(sprMarkup, sprOutputFormat, texMarkups); fittingTex != nullptr)
+				// NOTE: Rotating square sprites can never result in a better fit
+				const b8 allowRotation = (Settings.AllowRotatedSprites && sprMarkup.Size.x != sprMarkup.Size.y);
+
+				const auto[fittingTex, fittingSprBox] = (strategy == SprPackingStrategy::MaxRects) ?
+					FindFittingTexMarkupFreeRectToPlaceSprIn(sprMarkup.Size, allowRotation, sprOutputFormat, texMarkups) :
+					FindFittingTexMarkupToPlaceSprIn(sprMarkup.Size, allowRotation, sprOutputFormat, texMarkups);
+
+				if (fittingTex != nullptr)
 				{
-					fittingTex->SpriteBoxes.push_back({ &sprMarkup, fittingSprBox });
-					fittingTex->RemainingFreePixels -= Area(GetBoxSize(fittingSprBox));
+					const b8 rotated = (GetBoxSize(fittingSprBox) != sprMarkup.Size + (Settings.SpritePadding * 2));
+					placeSprBox(*fittingTex, sprMarkup, fittingSprBox, rotated);
 				}
 				else
 				{
-					const auto newTextureSize = Settings.MaxTextureSize;
-					addNewTexMarkup(newTextureSize, sprMarkup, sprMarkup.Size + (Settings.SpritePadding * 2), sprOutputFormat, SprMergeType::Merge);
+					// NOTE: If a sprite no longer fits into any of the existing textures then neither will any of the following ones of the same size
+					if (Settings.UniformSizeGridPlacement)
+					{
+						while (sprIndex + placedSprCount < sizeSortedSprMarkups.size() && CanBePlacedOnSameGrid(sprMarkup, *sizeSortedSprMarkups[sprIndex + placedSprCount]))
+							placedSprCount++;
+					}
+
+					placeSprRunOnGrid(sprIndex, placedSprCount);
 				}
 			}
 
-			currentProgress.Sprites++;
-			ReportCurrentProgress();
+			AdvanceProgressSprites(static_cast<u32>(placedSprCount));
+			sprIndex += placedSprCount;
 		}
 
-		AdjustTexMarkupSizes(texMarkups);
-		FinalTexMarkupSort(texMarkups);
-
 		return texMarkups;
 	}
 
-	std::vector<const SprMarkup*> SprPacker::SortByArea(const std::vector<SprMarkup>& sprMarkups) const
+	std::vector<const SprMarkup*> SprPacker::SortByPackingOrder(const std::vector<SprMarkup>& sprMarkups, SprPackingOrder order) const
 	{
 		std::vector<const SprMarkup*> result;
 		result.reserve(sprMarkups.size());
@@ -1007,66 +3086,164 @@ namespace Comfy
 		for (auto& sprMarkup : sprMarkups)
 			result.push_back(&sprMarkup);
 
-		std::sort(result.begin(), result.end(), [](auto& sprA, auto& sprB)
+		if (order == SprPackingOrder::Area)
+		{
+			std::sort(result.begin(), result.end(), [](auto& sprA, auto& sprB)
+			{
+				return Area(sprA->Size) > Area(sprB->Size);
+			});
+			return result;
+		}
+
+		auto getSortKey = [order](const SprMarkup& sprMarkup)
+		{
+			switch (order)
+			{
+			case SprPackingOrder::MaxSide: return Max(sprMarkup.Size.x, sprMarkup.Size.y);
+			case SprPackingOrder::Perimeter: return (sprMarkup.Size.x + sprMarkup.Size.y) * 2;
+			case SprPackingOrder::Height: return sprMarkup.Size.y;
+			default: return Area(sprMarkup.Size);
+			}
+		};
+
+		// NOTE: Fall back to the area for equal keys to not leave the order up to the sort implementation
+		std::sort(result.begin(), result.end(), [&](auto& sprA, auto& sprB)
 		{
-			return Area(sprA->Size) > Area(sprB->Size);
+			const i32 keyA = getSortKey(*sprA), keyB = getSortKey(*sprB);
+			return (keyA != keyB) ? (keyA > keyB) : (Area(sprA->Size) > Area(sprB->Size));
 		});
 
 		return result;
 	}
 
-	std::pair<SprTexMarkup*, ivec4> SprPacker::FindFittingTexMarkupToPlaceSprIn(const SprMarkup& sprToPlace, TextureFormat sprOutputFormat, std::vector<SprTexMarkup>& existingTexMarkups)
+	static std::optional<ivec4> FindFittingSprBoxInTexMarkup(const SprTexMarkup& texMarkup, ivec2 sprBoxSize)
 	{
 		static constexpr i32 stepSize = 1;
 		static constexpr i32 roughStepSize = 8;
 
-		for (auto& existingTexMarkup : existingTexMarkups)
-		{
-			if (existingTexMarkup.OutputFormat != sprOutputFormat)
-				continue;
-
-			if (existingTexMarkup.Merge == SprMergeType::NoMerge || existingTexMarkup.RemainingFreePixels < Area(sprToPlace.Size))
-				continue;
-
-			const ivec2 texBoxSize = existingTexMarkup.Size;
-			const ivec4 texBox = ivec4(ivec2(0, 0), texBoxSize);
+		const ivec2 texBoxSize = texMarkup.Size;
+		const ivec4 texBox = ivec4(ivec2(0, 0), texBoxSize);
 
-			const ivec2 sprBoxSize = sprToPlace.Size + (Settings.SpritePadding * 2);
-			ivec4 sprBox = ivec4(ivec2(0, 0), sprBoxSize);
+		ivec4 sprBox = ivec4(ivec2(0, 0), sprBoxSize);
 
 #if 0 // NOTE: Precise step only
-			for (sprBox.y = 0; sprBox.y < texBoxSize.y - sprBoxSize.y; sprBox.y += stepSize)
+		for (sprBox.y = 0; sprBox.y < texBoxSize.y - sprBoxSize.y; sprBox.y += stepSize)
+		{
+			for (sprBox.x = 0; sprBox.x < texBoxSize.x - sprBoxSize.x; sprBox.x += stepSize)
 			{
-				for (sprBox.x = 0; sprBox.x < texBoxSize.x - sprBoxSize.x; sprBox.x += stepSize)
-				{
-					if (FitsInsideTexture(texBox, existingTexMarkup.SpriteBoxes, sprBox))
-						return std::make_pair(&existingTexMarkup, sprBox);
-				}
+				if (FitsInsideTexture(texBox, texMarkup.Occupancy, sprBox))
+					return sprBox;
 			}
+		}
 #else // NOTE: Rough step first then precise adjust
-			for (sprBox.y = 0; sprBox.y < texBoxSize.y - sprBoxSize.y; sprBox.y += roughStepSize)
+		for (sprBox.y = 0; sprBox.y < texBoxSize.y - sprBoxSize.y; sprBox.y += roughStepSize)
+		{
+			for (sprBox.x = 0; sprBox.x < texBoxSize.x - sprBoxSize.x; sprBox.x += roughStepSize)
 			{
-				for (sprBox.x = 0; sprBox.x < texBoxSize.x - sprBoxSize.x; sprBox.x += roughStepSize)
+				// NOTE: Skip all rough steps that would still overlap the same occupied column, this yields the exact same placement
+				if (const i32 occupiedColumn = FindOccupiedColumn(texMarkup.Occupancy, sprBox); occupiedColumn >= 0)
 				{
-					if (!FitsInsideTexture(texBox, existingTexMarkup.SpriteBoxes, sprBox))
-						continue;
+					sprBox.x = (occupiedColumn / roughStepSize) * roughStepSize;
+					continue;
+				}
 
-					const auto roughSprBox = sprBox;
+				const auto roughSprBox = sprBox;
 
-					for (i32 preciseY = roughStepSize - 1; preciseY >= 0; preciseY--)
+				for (i32 preciseY = roughStepSize - 1; preciseY >= 0; preciseY--)
+				{
+					for (i32 preciseX = roughStepSize - 1; preciseX >= 0; preciseX--)
 					{
-						for (i32 preciseX = roughStepSize - 1; preciseX >= 0; preciseX--)
-						{
-							const auto preciseSprBox = ivec4(sprBox.x - preciseX, sprBox.y - preciseY, sprBox.z, sprBox.w);
-							if (FitsInsideTexture(texBox, existingTexMarkup.SpriteBoxes, preciseSprBox))
-								return std::make_pair(&existingTexMarkup, preciseSprBox);
-						}
+						const auto preciseSprBox = ivec4(sprBox.x - preciseX, sprBox.y - preciseY, sprBox.z, sprBox.w);
+						if (FitsInsideTexture(texBox, texMarkup.Occupancy, preciseSprBox))
+							return preciseSprBox;
 					}
-
-					return std::make_pair(&existingTexMarkup, roughSprBox);
 				}
+
+				return roughSprBox;
 			}
+		}
 #endif
+
+		return std::nullopt;
+	}
+
+	std::pair<SprTexMarkup*, ivec4> SprPacker::FindFittingTexMarkupToPlaceSprIn(ivec2 sprSize, b8 allowRotation, TextureFormat sprOutputFormat, std::vector<SprTexMarkup>& existingTexMarkups)
+	{
+		const ivec2 sprBoxSize = sprSize + (Settings.SpritePadding * 2);
+		const ivec2 rotatedSprBoxSize = ivec2(sprSize.y, sprSize.x) + (Settings.SpritePadding * 2);
+
+		for (auto& existingTexMarkup : existingTexMarkups)
+		{
+			if (existingTexMarkup.OutputFormat != sprOutputFormat)
+				continue;
+
+			if (existingTexMarkup.Merge == SprMergeType::NoMerge || existingTexMarkup.RemainingFreePixels < Area(sprSize))
+				continue;
+
+			const auto fittingSprBox = FindFittingSprBoxInTexMarkup(existingTexMarkup, sprBoxSize);
+			const auto rotatedFittingSprBox = allowRotation ? FindFittingSprBoxInTexMarkup(existingTexMarkup, rotatedSprBoxSize) : std::nullopt;
+
+			// NOTE: Of both orientations prefer whichever comes first in scan order
+			if (fittingSprBox.has_value() && rotatedFittingSprBox.has_value())
+			{
+				const b8 rotatedComesFirst = (rotatedFittingSprBox->y < fittingSprBox->y) || (rotatedFittingSprBox->y == fittingSprBox->y && rotatedFittingSprBox->x < fittingSprBox->x);
+				return std::make_pair(&existingTexMarkup, rotatedComesFirst ? rotatedFittingSprBox.value() : fittingSprBox.value());
+			}
+
+			if (fittingSprBox.has_value())
+				return std::make_pair(&existingTexMarkup, fittingSprBox.value());
+
+			if (rotatedFittingSprBox.has_value())
+				return std::make_pair(&existingTexMarkup, rotatedFittingSprBox.value());
+		}
+
+		return std::make_pair(static_cast<SprTexMarkup*>(nullptr), ivec4(0, 0, 0, 0));
+	}
+
+	std::pair<SprTexMarkup*, ivec4> SprPacker::FindFittingTexMarkupFreeRectToPlaceSprIn(ivec2 sprSize, b8 allowRotation, TextureFormat sprOutputFormat, std::vector<SprTexMarkup>& existingTexMarkups)
+	{
+		const ivec2 sprBoxSize = sprSize + (Settings.SpritePadding * 2);
+		const ivec2 rotatedSprBoxSize = ivec2(sprSize.y, sprSize.x) + (Settings.SpritePadding * 2);
+
+		for (auto& existingTexMarkup : existingTexMarkups)
+		{
+			if (existingTexMarkup.OutputFormat != sprOutputFormat)
+				continue;
+
+			if (existingTexMarkup.Merge == SprMergeType::NoMerge || existingTexMarkup.RemainingFreePixels < Area(sprBoxSize))
+				continue;
+
+			// NOTE: Best short side fit, ties are broken by the long side and then by the free rect order
+			std::optional<ivec4> bestSprBox;
+			i32 bestShortSideFit = I32Max, bestLongSideFit = I32Max;
+
+			auto tryFreeRect = [&](const ivec4& freeRect, ivec2 boxSize)
+			{
+				if (freeRect.z < boxSize.x || freeRect.w < boxSize.y)
+					return;
+
+				const i32 leftoverX = (freeRect.z - boxSize.x);
+				const i32 leftoverY = (freeRect.w - boxSize.y);
+				const i32 shortSideFit = Min(leftoverX, leftoverY);
+				const i32 longSideFit = Max(leftoverX, leftoverY);
+
+				if (shortSideFit < bestShortSideFit || (shortSideFit == bestShortSideFit && longSideFit < bestLongSideFit))
+				{
+					bestSprBox = ivec4(GetBoxPos(freeRect), boxSize);
+					bestShortSideFit = shortSideFit;
+					bestLongSideFit = longSideFit;
+				}
+			};
+
+			for (const auto& freeRect : existingTexMarkup.FreeRects)
+			{
+				tryFreeRect(freeRect, sprBoxSize);
+				if (allowRotation)
+					tryFreeRect(freeRect, rotatedSprBoxSize);
+			}
+
+			if (bestSprBox.has_value())
+				return std::make_pair(&existingTexMarkup, bestSprBox.value());
 		}
 
 		return std::make_pair(static_cast<SprTexMarkup*>(nullptr), ivec4(0, 0, 0, 0));
@@ -1125,10 +3302,140 @@ namespace Comfy
 		});
 	}
 
-	std::shared_ptr<Tex> SprPacker::CreateCompressTexFromMarkup(const SprTexMarkup& texMarkup)
+	TextureCacheKey SprPacker::CreateTexMarkupCacheKey(const SprTexMarkup& texMarkup) const
+	{
+		// NOTE: Bump whenever the output of any of the texture encoders changes so that outdated entries are no longer hit
+		constexpr u32 encoderVersion = 1;
+
+		// NOTE: The composition is fully determined by the sprite boxes and their pixels so there is no need to merge the texture just to hash it
+		TextureCacheKeyBuilder keyBuilder;
+		keyBuilder.AddValue(encoderVersion);
+		keyBuilder.AddValue(texMarkup.Size);
+		keyBuilder.AddValue(texMarkup.OutputFormat);
+		keyBuilder.AddValue(Settings.BackgroundColor.has_value());
+		keyBuilder.AddValue(Settings.BackgroundColor.value_or(0));
+		keyBuilder.AddValue(Settings.TransparencyColor.has_value());
+		keyBuilder.AddValue(Settings.TransparencyColor.value_or(0));
+		keyBuilder.AddValue(Settings.FlipTexturesY);
+		keyBuilder.AddValue(Settings.CompressionQuality);
+		keyBuilder.AddValue(Settings.YCbCrCompressionQuality);
+		keyBuilder.AddValue(Settings.CompressionQualityTarget.has_value());
+		keyBuilder.AddValue(Settings.CompressionQualityTarget.value_or(0.0f));
+		keyBuilder.AddValue(Settings.AllowYCbCrTextures);
+		keyBuilder.AddValue(Settings.AllowPunchThroughAlphaTextures);
+
+		for (const auto& sprBox : texMarkup.SpriteBoxes)
+		{
+			keyBuilder.AddValue(sprBox.Box);
+			keyBuilder.AddValue(sprBox.Rotated);
+			keyBuilder.AddValue(sprBox.Markup->Size);
+			keyBuilder.Add(GetSprRGBAPixels(*sprBox.Markup), Area(sprBox.Markup->Size) * RGBABytesPerPixel);
+		}
+
+		return keyBuilder.Finish();
+	}
+
+	std::shared_ptr<Tex> SprPacker::CreateLazyLoadedCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex)
+	{
+		const b8 loadsSprPixels = std::any_of(texMarkup.SpriteBoxes.begin(), texMarkup.SpriteBoxes.end(), [](const SprMarkupBox& sprBox) { return static_cast<b8>(sprBox.Markup->LoadRGBAPixels); });
+		if (!loadsSprPixels)
+			return CreateCompressTexFromMarkup(texMarkup, texIndex);
+
+		// NOTE: Everything is reserved up front in a single request so that textures never wait on each other while holding part of the budget
+		u64 reservedByteSize = static_cast<u64>(Area(texMarkup.Size)) * RGBABytesPerPixel;
+		for (const auto& sprBox : texMarkup.SpriteBoxes)
+			reservedByteSize += static_cast<u64>(Area(sprBox.Markup->Size)) * RGBABytesPerPixel;
+
+		const ScopedMemoryReservation reservation(Settings.DecodeMemoryBudget.get(), reservedByteSize);
+
+		// NOTE: The rest of the pipeline is handed a copy of the texture markup referring to copies of its sprite markups with the loaded pixels filled in,
+		//		 all of which are freed again once this texture is done
+		std::vector<ScopedSprRGBAPixels> sprPixels;
+		sprPixels.reserve(texMarkup.SpriteBoxes.size());
+		std::vector<SprMarkup> loadedSprMarkups;
+		loadedSprMarkups.reserve(texMarkup.SpriteBoxes.size());
+
+		SprTexMarkup loadedTexMarkup = texMarkup;
+		for (auto& sprBox : loadedTexMarkup.SpriteBoxes)
+		{
+			const auto& pixels = sprPixels.emplace_back(*sprBox.Markup);
+
+			auto& loadedSprMarkup = loadedSprMarkups.emplace_back(*sprBox.Markup);
+			loadedSprMarkup.RGBAPixels = pixels.Get();
+			loadedSprMarkup.LoadRGBAPixels = {};
+			sprBox.Markup = &loadedSprMarkup;
+		}
+
+		return CreateCompressTexFromMarkup(loadedTexMarkup, texIndex);
+	}
+
+	std::shared_ptr<Tex> SprPacker::CreateCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex)
+	{
+		// NOTE: Uncompressed textures would take just as long to load as they do to merge
+		const auto& cache = Settings.CompressedTextureCache;
+		if (cache == nullptr || texMarkup.CompressionType == SprCompressionType::NoComp)
+			return CreateUncachedCompressTexFromMarkup(texMarkup, texIndex);
+
+		auto loadStopwatch = CPUStopwatch::StartNew();
+		const auto cacheKey = CreateTexMarkupCacheKey(texMarkup);
+
+		auto cachedTex = std::make_shared<Tex>();
+		cachedTex->Name = texMarkup.Name;
+
+		if (cache->TryLoad(cacheKey, *cachedTex))
+		{
+			const auto loadTime = loadStopwatch.Stop();
+			{
+				const auto lock = std::scoped_lock(statisticsMutex);
+				Statistics.CachedTextures++;
+				Statistics.CompressTime += loadTime;
+			}
+
+			AdvanceProgressTexture(SprPackerPhase::Composite, texIndex, Time::Zero());
+			AdvanceProgressTexture(SprPackerPhase::Compress, texIndex, loadTime);
+			return cachedTex;
+		}
+
+		auto tex = CreateUncachedCompressTexFromMarkup(texMarkup, texIndex);
+
+		// NOTE: Textures that had to fall back to being uncompressed are left to be retried next time,
+		//		 unless the fallback was a deliberate choice of the quality budget
+		if (tex->GetFormat() == texMarkup.OutputFormat || Settings.CompressionQualityTarget.has_value())
+			cache->Store(cacheKey, *tex);
+
+		return tex;
+	}
+
+	std::shared_ptr<Tex> SprPacker::CreateUncachedCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex)
 	{
+		// NOTE: Single channel RGTC1 textures are already as small as block compression gets
+		if (Settings.CompressionQualityTarget.has_value() && texMarkup.CompressionType != SprCompressionType::NoComp && texMarkup.OutputFormat != TextureFormat::RGTC1)
+			return CreateQualityBudgetedTexFromMarkup(texMarkup, texIndex);
+
+		if (Settings.StreamTextureComposition && texMarkup.CompressionType != SprCompressionType::NoComp)
+		{
+			if (auto tex = CreateStreamedCompressTexFromMarkup(texMarkup, texIndex); tex != nullptr)
+				return tex;
+		}
+
+		auto compositeStopwatch = CPUStopwatch::StartNew();
 		auto mergedRGBAPixels = CreateMergedTexMarkupRGBAPixels(texMarkup);
 		const auto mergedByteSize = Area(texMarkup.Size) * RGBABytesPerPixel;
+		const auto compositeTime = compositeStopwatch.Stop();
+
+		AdvanceProgressTexture(SprPackerPhase::Composite, texIndex, compositeTime);
+
+		auto compressStopwatch = CPUStopwatch::StartNew();
+		defer
+		{
+			const auto compressTime = compressStopwatch.Stop();
+			{
+				const auto lock = std::scoped_lock(statisticsMutex);
+				Statistics.CompositeTime += compositeTime;
+				Statistics.CompressTime += compressTime;
+			}
+			AdvanceProgressTexture(SprPackerPhase::Compress, texIndex, compressTime);
+		};
 
 		auto tex = std::make_shared<Tex>();
 		tex->Name = texMarkup.Name;
@@ -1149,9 +3456,20 @@ namespace Comfy
 			return tex;
 		}
 
+		if (texMarkup.OutputFormat == TextureFormat::A8 || texMarkup.OutputFormat == TextureFormat::L8 || texMarkup.OutputFormat == TextureFormat::L8A8)
+		{
+			auto& mipMaps = tex->MipMapsArray.emplace_back();
+			auto& baseMipMap = mipMaps.emplace_back();
+			baseMipMap.Format = texMarkup.OutputFormat;
+			baseMipMap.Size = texMarkup.Size;
+			baseMipMap.DataSize = static_cast<u32>(TextureFormatByteSize(texMarkup.Size, texMarkup.OutputFormat));
+			baseMipMap.Data = ExtractRGBAChannels(texMarkup.Size, mergedRGBAPixels.get(), texMarkup.OutputFormat);
+			return tex;
+		}
+
 		if (texMarkup.OutputFormat == TextureFormat::RGTC2)
 		{
-			if (!CreateYACbCrTexture(texMarkup.Size, mergedRGBAPixels.get(), TextureFormat::RGBA8, mergedByteSize, *tex))
+			if (!CreateYACbCrTexture(texMarkup.Size, mergedRGBAPixels.get(), TextureFormat::RGBA8, mergedByteSize, *tex, Settings.YCbCrCompressionQuality, Settings.Multithreaded))
 				createUncompressedTexture();
 
 			return tex;
@@ -1164,8 +3482,9 @@ namespace Comfy
 		baseMipMap.DataSize = static_cast<u32>(TextureFormatByteSize(texMarkup.Size, texMarkup.OutputFormat));
 		baseMipMap.Data = std::make_unique<u8[]>(baseMipMap.DataSize);
 
-		if (!CompressTextureData(texMarkup.Size, mergedRGBAPixels.get(), TextureFormat::RGBA8, mergedByteSize, baseMipMap.Data.get(), texMarkup.OutputFormat, baseMipMap.DataSize))
+		if (!CompressTextureData(texMarkup.Size, mergedRGBAPixels.get(), TextureFormat::RGBA8, mergedByteSize, baseMipMap.Data.get(), texMarkup.OutputFormat, baseMipMap.DataSize, Settings.CompressionQuality, Settings.Multithreaded))
 		{
+			tex->MipMapsArray.clear();
 			createUncompressedTexture();
 			return tex;
 		}
@@ -1173,38 +3492,232 @@ namespace Comfy
 		return tex;
 	}
 
-	std::unique_ptr<u8[]> SprPacker::CreateMergedTexMarkupRGBAPixels(const SprTexMarkup& texMarkup)
+	std::shared_ptr<Tex> SprPacker::CreateStreamedCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex)
 	{
-		const size_t texDataSize = Area(texMarkup.Size) * RGBABytesPerPixel;
-		auto texData = std::make_unique<u8[]>(texDataSize);
+		std::mutex compositeTimeMutex;
+		Time compositeTime = Time::Zero();
+
+		const RGBARowSource rowSource = [&](i32 firstRow, i32 rowCount, u32* scratchRows) -> const u32*
+		{
+			auto compositeStopwatch = CPUStopwatch::StartNew();
+			ComposeTexMarkupRows(texMarkup, firstRow, rowCount, scratchRows);
+			const auto rowsCompositeTime = compositeStopwatch.Stop();
+
+			const auto lock = std::scoped_lock(compositeTimeMutex);
+			compositeTime += rowsCompositeTime;
+			return scratchRows;
+		};
+
+		auto tex = std::make_shared<Tex>();
+		tex->Name = texMarkup.Name;
 
-		if (texMarkup.SpriteBoxes.size() == 1 && texMarkup.SpriteBoxes.front().Markup->Size == texMarkup.Size)
+		auto streamStopwatch = CPUStopwatch::StartNew();
+		b8 success = false;
+
+		if (texMarkup.OutputFormat == TextureFormat::RGTC2)
 		{
-			std::memcpy(texData.get(), texMarkup.SpriteBoxes.front().Markup->RGBAPixels, texDataSize);
+			success = CreateYACbCrTextureFromRows(texMarkup.Size, rowSource, *tex, Settings.YCbCrCompressionQuality, Settings.Multithreaded);
 		}
 		else
 		{
-			if (Settings.BackgroundColor.has_value())
+			auto& mipMaps = tex->MipMapsArray.emplace_back();
+			auto& baseMipMap = mipMaps.emplace_back();
+			baseMipMap.Format = texMarkup.OutputFormat;
+			baseMipMap.Size = texMarkup.Size;
+			baseMipMap.DataSize = static_cast<u32>(TextureFormatByteSize(texMarkup.Size, texMarkup.OutputFormat));
+			baseMipMap.Data = std::make_unique<u8[]>(baseMipMap.DataSize);
+
+			success = CompressTextureDataFromRows(texMarkup.Size, rowSource, baseMipMap.Data.get(), texMarkup.OutputFormat, baseMipMap.DataSize, Settings.CompressionQuality, Settings.Multithreaded);
+		}
+
+		const auto streamTime = streamStopwatch.Stop();
+
+		// NOTE: Let the caller fall back to merging the entire texture up front
+		if (!success)
+			return nullptr;
+
+		// NOTE: Composition is interleaved with compression across all strips so the summed up composition time is only an approximation
+		const auto compressTime = (streamTime > compositeTime) ? (streamTime - compositeTime) : Time::Zero();
+		{
+			const auto lock = std::scoped_lock(statisticsMutex);
+			Statistics.CompositeTime += compositeTime;
+			Statistics.CompressTime += compressTime;
+		}
+
+		AdvanceProgressTexture(SprPackerPhase::Composite, texIndex, compositeTime);
+		AdvanceProgressTexture(SprPackerPhase::Compress, texIndex, compressTime);
+		return tex;
+	}
+
+	std::shared_ptr<Tex> SprPacker::CreateQualityBudgetedTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex)
+	{
+		// NOTE: Every candidate has to be measured against the same fully merged texture so there is no point in streaming it
+		auto compositeStopwatch = CPUStopwatch::StartNew();
+		auto mergedRGBAPixels = CreateMergedTexMarkupRGBAPixels(texMarkup);
+		const auto mergedByteSize = Area(texMarkup.Size) * RGBABytesPerPixel;
+		const auto compositeTime = compositeStopwatch.Stop();
+
+		AdvanceProgressTexture(SprPackerPhase::Composite, texIndex, compositeTime);
+
+		auto compressStopwatch = CPUStopwatch::StartNew();
+		defer
+		{
+			const auto compressTime = compressStopwatch.Stop();
+			{
+				const auto lock = std::scoped_lock(statisticsMutex);
+				Statistics.CompositeTime += compositeTime;
+				Statistics.CompressTime += compressTime;
+			}
+			AdvanceProgressTexture(SprPackerPhase::Compress, texIndex, compressTime);
+		};
+
+		const f64 qualityTarget = static_cast<f64>(Settings.CompressionQualityTarget.value());
+
+		// NOTE: Returns null for candidates that either failed to encode or don't meet the target, the decoded pixels are discarded right after being measured
+		auto encodeCandidate = [&](TextureFormat format) -> std::shared_ptr<Tex>
+		{
+			auto tex = std::make_shared<Tex>();
+			tex->Name = texMarkup.Name;
+
+			if (format == TextureFormat::RGTC2)
+			{
+				if (!CreateYACbCrTexture(texMarkup.Size, mergedRGBAPixels.get(), TextureFormat::RGBA8, mergedByteSize, *tex, Settings.YCbCrCompressionQuality, Settings.Multithreaded))
+					return nullptr;
+			}
+			else
 			{
-				const auto backgroundColor = Settings.BackgroundColor.value();
-				for (size_t i = 0; i < texDataSize / RGBABytesPerPixel; i++)
-					reinterpret_cast<u32*>(texData.get())[i] = backgroundColor;
+				auto& mipMaps = tex->MipMapsArray.emplace_back();
+				auto& baseMipMap = mipMaps.emplace_back();
+				baseMipMap.Format = format;
+				baseMipMap.Size = texMarkup.Size;
+				baseMipMap.DataSize = static_cast<u32>(TextureFormatByteSize(texMarkup.Size, format));
+				baseMipMap.Data = std::make_unique<u8[]>(baseMipMap.DataSize);
+
+				if (!CompressTextureData(texMarkup.Size, mergedRGBAPixels.get(), TextureFormat::RGBA8, mergedByteSize, baseMipMap.Data.get(), format, baseMipMap.DataSize, Settings.CompressionQuality, Settings.Multithreaded))
+					return nullptr;
 			}
 
-			for (const auto& sprBox : texMarkup.SpriteBoxes)
-				CopySprIntoTex(texMarkup, texData.get(), sprBox);
+			auto decodedRGBAPixels = std::make_unique<u8[]>(mergedByteSize);
+			if (!ConvertTextureToRGBABuffer(*tex, decodedRGBAPixels.get(), mergedByteSize))
+				return nullptr;
+
+			if (CalculateRGBAPSNR(texMarkup.Size, mergedRGBAPixels.get(), decodedRGBAPixels.get(), (format != TextureFormat::DXT1)) < qualityTarget)
+				return nullptr;
+
+			return tex;
+		};
+
+		std::vector<ThreadPool::Task<std::shared_ptr<Tex>>> candidateTasks;
+		for (const auto format : GetQualityBudgetCandidateFormats(texMarkup))
+		{
+			candidateTasks.push_back(ThreadPool::GetShared().Submit(Settings.Multithreaded, [&encodeCandidate, format]
+			{
+				return encodeCandidate(format);
+			}));
+		}
+
+		// NOTE: The candidates are ordered by size so the first one to meet the target is also the smallest.
+		//		 Larger candidates that haven't been started by then are skipped, which when running deferred means they are never even encoded
+		for (auto& candidateTask : candidateTasks)
+		{
+			if (auto tex = candidateTask.Get(); tex != nullptr)
+				return tex;
+		}
+
+		auto tex = std::make_shared<Tex>();
+		tex->Name = texMarkup.Name;
+
+		auto& mipMaps = tex->MipMapsArray.emplace_back();
+		auto& baseMipMap = mipMaps.emplace_back();
+		baseMipMap.Format = TextureFormat::RGBA8;
+		baseMipMap.Size = texMarkup.Size;
+		baseMipMap.DataSize = static_cast<u32>(mergedByteSize);
+		baseMipMap.Data = std::move(mergedRGBAPixels);
+		return tex;
+	}
+
+	std::vector<TextureFormat> SprPacker::GetQualityBudgetCandidateFormats(const SprTexMarkup& texMarkup) const
+	{
+		b8 allOpaque = true, allBinaryAlpha = true;
+		for (const auto& sprBox : texMarkup.SpriteBoxes)
+		{
+			const auto channelUsage = AnalyzeSprChannelUsage(*sprBox.Markup);
+			allOpaque &= channelUsage.Opaque;
+			allBinaryAlpha &= channelUsage.BinaryAlpha;
 		}
 
-		// TODO: Remove this as it can easily causes sampling artifacts (?)
-		if (Settings.TransparencyColor.has_value())
-			SetPixelsUniformTransparency(texMarkup.Size, texData.get(), Settings.TransparencyColor.value());
+		// NOTE: In order of increasing size, 4 bits per pixel for DXT1, 8 for DXT5 and 8 + 2 for the full resolution YA and half resolution CbCr RGTC2 pair.
+		//		 DXT5 can't improve on the color of DXT1 and so only makes sense for textures that actually need an alpha channel
+		std::vector<TextureFormat> candidateFormats;
+		if (allOpaque)
+			candidateFormats.push_back(TextureFormat::DXT1);
+		else if (allBinaryAlpha && Settings.AllowPunchThroughAlphaTextures)
+			candidateFormats.push_back(TextureFormat::DXT1a);
+
+		if (!allOpaque)
+			candidateFormats.push_back(TextureFormat::DXT5);
+
+		if (Settings.AllowYCbCrTextures)
+			candidateFormats.push_back(TextureFormat::RGTC2);
 
-		if (Settings.FlipTexturesY)
-			FlipTextureY(texMarkup.Size, texData.get());
+		return candidateFormats;
+	}
 
+	std::unique_ptr<u8[]> SprPacker::CreateMergedTexMarkupRGBAPixels(const SprTexMarkup& texMarkup) const
+	{
+		auto texData = std::make_unique<u8[]>(Area(texMarkup.Size) * RGBABytesPerPixel);
+		ComposeTexMarkupRows(texMarkup, 0, texMarkup.Size.y, reinterpret_cast<u32*>(texData.get()));
 		return texData;
 	}
 
+	void SprPacker::ComposeTexMarkupRows(const SprTexMarkup& texMarkup, i32 firstRow, i32 rowCount, u32* outRows) const
+	{
+		const auto texSize = texMarkup.Size;
+		const b8 isSingleFullSizeSpr = (texMarkup.SpriteBoxes.size() == 1 && !texMarkup.SpriteBoxes.front().Rotated && texMarkup.SpriteBoxes.front().Markup->Size == texSize);
+
+		// NOTE: Only the sprite boxes overlapping the requested rows need to be looked at for every row
+		std::vector<const SprMarkupBox*> rowSprBoxes;
+		if (!isSingleFullSizeSpr)
+		{
+			const i32 minTexRow = Settings.FlipTexturesY ? (texSize.y - firstRow - rowCount) : firstRow;
+			const i32 maxTexRow = minTexRow + rowCount;
+
+			for (const auto& sprBox : texMarkup.SpriteBoxes)
+			{
+				if (sprBox.Box.y < maxTexRow && (sprBox.Box.y + sprBox.Box.w) > minTexRow)
+					rowSprBoxes.push_back(&sprBox);
+			}
+		}
+
+		const u32 backgroundColor = Settings.BackgroundColor.value_or(0x00000000);
+
+		for (i32 row = 0; row < rowCount; row++)
+		{
+			// NOTE: Flipping is done by simply composing the rows in reverse order
+			const i32 texRowIndex = Settings.FlipTexturesY ? (texSize.y - 1 - (firstRow + row)) : (firstRow + row);
+			u32* texRow = &outRows[static_cast<size_t>(row) * texSize.x];
+
+			if (isSingleFullSizeSpr)
+			{
+				std::memcpy(texRow, &GetPixel(texSize.x, GetSprRGBAPixels(*texMarkup.SpriteBoxes.front().Markup), 0, texRowIndex), texSize.x * RGBABytesPerPixel);
+			}
+			else
+			{
+				std::fill(texRow, texRow + texSize.x, backgroundColor);
+
+				for (const auto* sprBox : rowSprBoxes)
+				{
+					if (texRowIndex >= sprBox->Box.y && texRowIndex < (sprBox->Box.y + sprBox->Box.w))
+						CopySprRowIntoTexRow(*sprBox, texRowIndex - sprBox->Box.y, texRow + sprBox->Box.x);
+				}
+			}
+
+			// TODO: Remove this as it can easily causes sampling artifacts (?)
+			if (Settings.TransparencyColor.has_value())
+				SetPixelsUniformTransparency(texSize.x, texRow, Settings.TransparencyColor.value());
+		}
+	}
+
 	SprCompressionType SprPacker::GetCompressionType(TextureFormat format) const
 	{
 		switch (format)
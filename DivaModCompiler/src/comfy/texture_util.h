@@ -23,11 +23,34 @@
 #pragma once
 #include "core_types.h"
 #include "file_format_spr_set.h"
+#include "texture_cache.h"
+#include "memory_budget.h"
 #include <optional>
+#include <future>
+#include <mutex>
 
 namespace Comfy
 {
-	b8 ReadImageFile(std::string_view filePath, ivec2& outSize, std::unique_ptr<u8[]>& outRGBAPixels);
+	// NOTE: Decoded pixels are handed out in the buffer allocated by the image decoder itself and so have to be freed by it as well
+	struct DecodedImageDeleter { void operator()(u8* pixels) const; };
+	using DecodedImagePixels = std::unique_ptr<u8[], DecodedImageDeleter>;
+
+	b8 ReadImageFile(std::string_view filePath, ivec2& outSize, DecodedImagePixels& outRGBAPixels);
+
+	// NOTE: Same as ReadImageFile but for the contents of an image file that has already been read or memory mapped, see MappedFile
+	b8 DecodeImageFileData(const u8* fileData, size_t fileSize, ivec2& outSize, DecodedImagePixels& outRGBAPixels);
+
+	// NOTE: Everything about an image that can be told from its file header alone, without decoding any of its pixels
+	struct ImageFileInfo
+	{
+		ivec2 Size;
+		// NOTE: Only cleared if the file format guarantees every pixel to be fully opaque
+		b8 HasAlpha;
+		// NOTE: Only set if the file format guarantees R, G and B to be equal for every pixel
+		b8 Grayscale;
+	};
+
+	b8 ReadImageFileInfo(const u8* fileData, size_t fileSize, ImageFileInfo& outInfo);
 	b8 WriteImageFile(std::string_view filePath, ivec2 size, const void* rgbaPixels);
 }
 
@@ -50,9 +73,14 @@ namespace Comfy
 	// NOTE: Raw decompression routine, the output format must not be compressed
 	b8 DecompressTextureData(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize);
 
+	// NOTE: Draft encodes RGBA8 input with a quick in-tree range fit and no DirectXTex call at all, Normal uses the DirectXTex encoder
+	//		 and Max additionally runs an in-tree cluster fit and endpoint search for every block, keeping whichever encoding has the lower error
+	enum class TextureCompressionQuality : u8 { Draft, Normal, Max, Count };
+
 	// NOTE: Raw compression routine, the input format must not be compressed
-	//		 While reasonably fast to compute, the output is not quite as high quallity as that of the slow NVTT compression
-	b8 CompressTextureData(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize);
+	//		 While reasonably fast to compute, the output is not quite as high quallity as that of the slow NVTT compression.
+	//		 Large images are split into strips of block rows which are compressed in parallel unless multithreaded is false
+	b8 CompressTextureData(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize, TextureCompressionQuality quality = TextureCompressionQuality::Normal, b8 multithreaded = true);
 
 	// NOTE: For internal use, usually shouldn't be called on its own.
 	b8 ConvertYACbCrToRGBABuffer(const TexMipMap& mipMapYA, const TexMipMap& mipMapCbCr, u8* outData, size_t outByteSize);
@@ -60,7 +88,26 @@ namespace Comfy
 	// NOTE: For internal use, usually shouldn't be called on its own. Both the YA and CbCr buffers are expected to be the same size
 	b8 ConvertRGBAToYACbCrBuffer(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, u8* outYAData, u8* outCbCrData);
 
-	b8 CreateYACbCrTexture(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, Tex& outTexture);
+	// NOTE: Highest instruction set extension the pixel conversion kernels below may use, detected at runtime
+	enum class SimdLevel : u8 { Scalar, SSE41, AVX2, Count };
+
+	SimdLevel GetSupportedSimdLevel();
+
+	// NOTE: Caps the level used by all threads, mostly useful for benchmarking and validating the SIMD paths against the scalar one
+	void SetMaxSimdLevel(SimdLevel level);
+
+	// NOTE: Tightly packed per pixel conversion with the YA and CbCr buffers both at full resolution
+	void ConvertRGBAToYACbCrPixels(const u32* inRGBA, u8* outYA, u8* outCbCr, size_t pixelCount);
+	void ConvertYACbCrToRGBAPixels(const u8* inYA, const u8* inCbCr, u32* outRGBA, size_t pixelCount);
+
+	// NOTE: Trades encoding speed for quality, Fast only uses the block min / max as endpoints while High additionally brute forces their neighborhood
+	enum class RGTCQuality : u8 { Fast, Normal, High, Count };
+
+	// NOTE: Integer RGTC1 (BC4) / RGTC2 (BC5) encoder working directly on tightly packed R8 / R8G8 pixels, independent of DirectXTex.
+	//		 Partial edge blocks are padded by repeating the last row and column
+	b8 CompressRGTCData(ivec2 size, const u8* inData, size_t inByteSize, u8* outData, TextureFormat outFormat, size_t outByteSize, RGTCQuality quality = RGTCQuality::Normal, b8 multithreaded = true);
+
+	b8 CreateYACbCrTexture(ivec2 size, const u8* inData, TextureFormat inFormat, size_t inByteSize, Tex& outTexture, RGTCQuality quality = RGTCQuality::Normal, b8 multithreaded = true);
 
 	// NOTE: Includes automatic checking and decoding of YACbCr RGTC2 textures
 	b8 ConvertTextureToRGBABuffer(const Tex& inTexture, u8* outData, size_t outByteSize, i32 cubeFace = 0);
@@ -87,12 +134,26 @@ namespace Comfy
 	// NOTE: Defined in sort order
 	enum class SprCompressionType : u8 { BC4Comp, BC5Comp, D5Comp, NoComp, UnkComp, Count };
 
+	// NOTE: PixelScan is the original brute force placement, MaxRects tracks the free space of each texture instead
+	enum class SprPackingStrategy : u8 { PixelScan, MaxRects, Count };
+
+	// NOTE: Sprites are placed in descending order of the respective size measure
+	enum class SprPackingOrder : u8 { Area, MaxSide, Perimeter, Height, Count };
+
+	// NOTE: Layout runs once for the whole set while composite and compress run once per texture
+	enum class SprPackerPhase : u8 { Layout, Composite, Compress, Count };
+
 	using SprMarkupFlags = u32;
 	enum SprMarkupFlagsEnum : SprMarkupFlags
 	{
 		SprMarkupFlags_None = 0,
 		SprMarkupFlags_NoMerge = (1 << 0),
 		SprMarkupFlags_Compress = (1 << 1),
+		// NOTE: Pick the output format from the two header flags below instead of analyzing the pixels, so the layout doesn't have to wait for them.
+		//		 Only as accurate as the image file header, a source image with an alpha channel is treated as transparent even if every pixel is opaque
+		SprMarkupFlags_HeaderChannelHints = (1 << 3),
+		SprMarkupFlags_HeaderOpaque = (1 << 4),
+		SprMarkupFlags_HeaderGrayscale = (1 << 5),
 	};
 
 	struct SprMarkup
@@ -102,12 +163,31 @@ namespace Comfy
 		const void* RGBAPixels;
 		ScreenMode ScreenMode;
 		SprMarkupFlags Flags;
+
+		// NOTE: Used in place of RGBAPixels while that is null, for sprites created from their image file header while the pixels are still being decoded.
+		//		 The packer only waits on it once the pixels of this particular sprite are actually needed
+		std::shared_future<const void*> PendingRGBAPixels;
+
+		// NOTE: Alternative to both of the above for builds with bounded memory usage. Invoked every time the pixels are needed, which are then freed again right after.
+		//		 Each texture only loads its own sprites once it is composited, see SettingsData::DecodeMemoryBudget. Returning null is treated as a fully transparent sprite
+		std::function<DecodedImagePixels()> LoadRGBAPixels;
 	};
 
 	struct SprMarkupBox
 	{
 		const SprMarkup* Markup;
 		ivec4 Box;
+
+		// NOTE: Stored turned 90 degrees clockwise, the box then spans the sprite height horizontally and its width vertically
+		b8 Rotated;
+	};
+
+	// NOTE: One bit per texture pixel, set for every pixel covered by a sprite box
+	struct SprTexOccupancy
+	{
+		ivec2 Size;
+		i32 WordsPerRow;
+		std::vector<u64> Bits;
 	};
 
 	struct SprTexMarkup
@@ -120,11 +200,31 @@ namespace Comfy
 		u16 FormatTypeIndex;
 		std::vector<SprMarkupBox> SpriteBoxes;
 		i32 RemainingFreePixels;
+
+		// NOTE: Maximal free rectangles, only maintained by the MaxRects packing strategy
+		std::vector<ivec4> FreeRects;
+
+		// NOTE: Only maintained by the PixelScan packing strategy to avoid testing against every existing sprite box
+		SprTexOccupancy Occupancy;
 	};
 
 	struct SprPacker
 	{
-		struct ProgressData { u32 Sprites, SpritesTotal; };
+		struct ProgressData
+		{
+			SprPackerPhase Phase;
+			u32 Sprites, SpritesTotal;
+			u32 Textures, TexturesTotal;
+
+			// NOTE: Index of the texture that just finished the current phase or -1 during layout
+			i32 TextureIndex;
+			// NOTE: Time spent on this phase of the texture at TextureIndex
+			Time PhaseTime;
+			// NOTE: Since the start of Create()
+			Time Elapsed;
+		};
+
+		// NOTE: Might be invoked from any of the worker threads, though never concurrently
 		using ProgressCallback = std::function<void(SprPacker&, ProgressData)>;
 
 		SprPacker() = default;
@@ -133,6 +233,21 @@ namespace Comfy
 
 		std::unique_ptr<SprSet> Create(const std::vector<SprMarkup>& sprMarkups);
 
+		// NOTE: Reset and filled in by each call to Create()
+		struct StatisticsData
+		{
+			u32 DuplicateSprites;
+			size_t DuplicateSpriteBytes;
+
+			// NOTE: Compressed textures loaded from the cache instead of being compressed again
+			u32 CachedTextures;
+
+			// NOTE: The composite and compress times are summed up across all worker threads
+			Time LayoutTime;
+			Time CompositeTime;
+			Time CompressTime;
+		} Statistics = {};
+
 		struct SettingsData
 		{
 			// NOTE: Set to 0xFFFF00FF for debugging but fully transparent by default to avoid cross sprite boundary block compression artifacts
@@ -150,9 +265,56 @@ namespace Comfy
 			// NOTE: Number of pixels at each side
 			ivec2 SpritePadding = ivec2(2, 2);
 
+			// NOTE: MaxRects is considerably faster for large sets but produces a different layout than the original pixel scan
+			SprPackingStrategy PackingStrategy = SprPackingStrategy::PixelScan;
+
+			// NOTE: Place runs of equally sized sprites, such as song thumbnails, arithmetically on a grid once they no longer fit into the existing textures.
+			//		 Much faster for large sets of thumbnails but produces a different layout than the original pixel scan, even for mixed size sets
+			b8 UniformSizeGridPlacement = false;
+
+			// NOTE: Sprites with identical pixels and flags are only packed once and then share the same texture region.
+			//		 Changes the layout of every set that contains repeated images
+			b8 MergeDuplicateSprites = false;
+
+			// NOTE: Allow merged sprites to be placed rotated by 90 degrees if that fits better, requires Spr::Rotate support by the reader
+			b8 AllowRotatedSprites = false;
+
+			// NOTE: Try every combination of packing order and strategy and keep the layout with the smallest total texture area.
+			//		 Takes several times longer to pack so mostly intended for release builds, overrides the PackingStrategy
+			b8 OptimizePacking = false;
+
 			// NOTE: Generally higher quallity than block compression on its own at the cost of additional encoding and decoding time
 			b8 AllowYCbCrTextures = true;
 
+			// NOTE: Draft is intended for quick iteration on large sets and Max for release builds, YCbCr textures use their own setting below
+			TextureCompressionQuality CompressionQuality = TextureCompressionQuality::Normal;
+
+			// NOTE: Only used for YCbCr textures, which are compressed by the in-tree RGTC encoder
+			RGTCQuality YCbCrCompressionQuality = RGTCQuality::Normal;
+
+			// NOTE: Grayscale and white alpha-only sprites are stored as RGTC1, L8, L8A8 or A8 textures.
+			//		 Requires the host application to expand these to RGBA when sampling, a plain sampler reads them as red or black
+			b8 AllowSingleChannelTextures = false;
+
+			// NOTE: Sprites with only fully opaque or fully transparent pixels are stored as DXT1a instead of DXT5.
+			//		 DXT1a decodes transparent texels as black which shows up as dark fringes around bilinear filtered edges that aren't premultiplied
+			b8 AllowPunchThroughAlphaTextures = false;
+
+			// NOTE: Minimum peak signal to noise ratio in decibels. When set, every compressed texture is encoded in each eligible format in parallel,
+			//		 decoded again and the smallest one meeting the target is kept, falling back to RGBA8 if none of them do
+			std::optional<f32> CompressionQualityTarget = {};
+
+			// NOTE: Compose and compress block compressed textures a few block rows at a time instead of first merging the entire texture in memory.
+			//		 The output is identical either way, uncompressed textures always have to be merged in full
+			b8 StreamTextureComposition = true;
+
+			// NOTE: Optional and usually shared across multiple packer instances, compressed textures with unchanged input are loaded from it instead of being compressed again
+			std::shared_ptr<TextureCache> CompressedTextureCache = {};
+
+			// NOTE: Optional and usually shared across multiple packer instances, limits how many textures with lazily loaded sprites are being composited at once.
+			//		 Each of them reserves the size of its merged RGBA pixels plus that of all of its decoded sprites before loading any of them
+			std::shared_ptr<MemoryBudget> DecodeMemoryBudget = {};
+
 			// NOTE: Conventionally required for texture block compression as well as older graphics APIs / hardware
 			b8 PowerOfTwoTextures = true;
 
@@ -165,24 +327,43 @@ namespace Comfy
 
 	private:
 		ProgressData currentProgress = {};
+		CPUStopwatch createStopwatch = {};
 		ProgressCallback progressCallback;
+		std::mutex progressMutex;
+		std::mutex statisticsMutex;
 
 		void ReportCurrentProgress();
+		void AdvanceProgressSprites(u32 sprites);
+		void AdvanceProgressTexture(SprPackerPhase phase, size_t texIndex, Time phaseTime);
 
+		b8 IsSprOutputUncompressed(const SprMarkup& sprMarkup) const;
+		b8 DoesSprOutputFormatDependOnPixels(const SprMarkup& sprMarkup) const;
 		TextureFormat DetermineSprOutputFormat(const SprMarkup& sprMarkup) const;
 
+		std::vector<SprMarkup> RemoveDuplicateSprMarkups(const std::vector<SprMarkup>& sprMarkups, std::vector<std::vector<const SprMarkup*>>& outDuplicates);
+
 		std::vector<SprTexMarkup> MergeTextures(const std::vector<SprMarkup>& sprMarkups);
-		std::vector<const SprMarkup*> SortByArea(const std::vector<SprMarkup>& sprMarkups) const;
+		std::vector<SprTexMarkup> MergeTexturesUsing(const std::vector<SprMarkup>& sprMarkups, const std::vector<TextureFormat>& sprOutputFormats, SprPackingOrder order, SprPackingStrategy strategy);
+		std::vector<SprTexMarkup> MergeTexturesOfFormat(const std::vector<const SprMarkup*>& sizeSortedSprMarkups, TextureFormat sprOutputFormat, SprPackingStrategy strategy);
+		std::vector<const SprMarkup*> SortByPackingOrder(const std::vector<SprMarkup>& sprMarkups, SprPackingOrder order) const;
 
-		std::pair<SprTexMarkup*, ivec4> FindFittingTexMarkupToPlaceSprIn(const SprMarkup& sprToPlace, TextureFormat sprOutputFormat, std::vector<SprTexMarkup>& existingTexMarkups);
+		std::pair<SprTexMarkup*, ivec4> FindFittingTexMarkupToPlaceSprIn(ivec2 sprSize, b8 allowRotation, TextureFormat sprOutputFormat, std::vector<SprTexMarkup>& existingTexMarkups);
+		std::pair<SprTexMarkup*, ivec4> FindFittingTexMarkupFreeRectToPlaceSprIn(ivec2 sprSize, b8 allowRotation, TextureFormat sprOutputFormat, std::vector<SprTexMarkup>& existingTexMarkups);
 		void AdjustTexMarkupSizes(std::vector<SprTexMarkup>& texMarkups) const;
 
 		// NOTE: Theses serve no functional purpose other than to make the final output look consistent and cleaner
 		void FinalTexMarkupSort(std::vector<SprTexMarkup>& texMarkups) const;
 		void FinalSpriteSort(std::vector<Spr>& sprites) const;
 
-		std::shared_ptr<Tex> CreateCompressTexFromMarkup(const SprTexMarkup& texMarkup);
-		std::unique_ptr<u8[]> CreateMergedTexMarkupRGBAPixels(const SprTexMarkup& texMarkup);
+		TextureCacheKey CreateTexMarkupCacheKey(const SprTexMarkup& texMarkup) const;
+		std::shared_ptr<Tex> CreateLazyLoadedCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex);
+		std::shared_ptr<Tex> CreateCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex);
+		std::shared_ptr<Tex> CreateUncachedCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex);
+		std::shared_ptr<Tex> CreateStreamedCompressTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex);
+		std::shared_ptr<Tex> CreateQualityBudgetedTexFromMarkup(const SprTexMarkup& texMarkup, size_t texIndex);
+		std::vector<TextureFormat> GetQualityBudgetCandidateFormats(const SprTexMarkup& texMarkup) const;
+		std::unique_ptr<u8[]> CreateMergedTexMarkupRGBAPixels(const SprTexMarkup& texMarkup) const;
+		void ComposeTexMarkupRows(const SprTexMarkup& texMarkup, i32 firstRow, i32 rowCount, u32* outRows) const;
 
 		SprCompressionType GetCompressionType(TextureFormat format) const;
 		cstr GetMergeName(SprMergeType merge) const;
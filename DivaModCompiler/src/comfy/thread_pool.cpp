@@ -0,0 +1,86 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "thread_pool.h"
+
+namespace Comfy
+{
+	ThreadPool::ThreadPool(size_t workerCount)
+	{
+		workerThreads.reserve(workerCount);
+		for (size_t i = 0; i < workerCount; i++)
+			workerThreads.emplace_back([this] { WorkerThreadLoop(); });
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			const auto lock = std::scoped_lock(mutex);
+			stopRequested = true;
+		}
+
+		pendingCondition.notify_all();
+		for (auto& thread : workerThreads)
+			thread.join();
+	}
+
+	ThreadPool& ThreadPool::GetShared()
+	{
+		static ThreadPool sharedPool(Max<size_t>(std::thread::hardware_concurrency(), 1));
+		return sharedPool;
+	}
+
+	size_t ThreadPool::GetWorkerCount() const
+	{
+		return workerThreads.size();
+	}
+
+	void ThreadPool::Enqueue(std::shared_ptr<TaskEntry> entry)
+	{
+		{
+			const auto lock = std::scoped_lock(mutex);
+			pendingEntries.push_back(std::move(entry));
+		}
+
+		pendingCondition.notify_one();
+	}
+
+	void ThreadPool::WorkerThreadLoop()
+	{
+		while (true)
+		{
+			std::shared_ptr<TaskEntry> entry;
+			{
+				auto lock = std::unique_lock(mutex);
+				pendingCondition.wait(lock, [&] { return stopRequested || !pendingEntries.empty(); });
+
+				if (pendingEntries.empty())
+					return;
+
+				entry = std::move(pendingEntries.front());
+				pendingEntries.pop_front();
+			}
+
+			// NOTE: Entries that have already been run by a waiting thread are simply dropped here
+			entry->TryRun();
+		}
+	}
+}
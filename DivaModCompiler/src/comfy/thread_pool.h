@@ -0,0 +1,123 @@
+// MIT License
+//
+// Copyright(c) 2022 samyuu
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this softwareand associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+#include "core_types.h"
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Comfy
+{
+	// NOTE: Fixed set of worker threads shared by everything that splits its work into tasks, so nested parallelism never multiplies the number of threads.
+	//		 A task that no worker has started yet by the time it is waited on runs on the waiting thread instead,
+	//		 so tasks can wait on tasks they submitted themselves without ever starving the workers
+	class ThreadPool : NonCopyable
+	{
+	private:
+		struct TaskEntry
+		{
+			std::atomic<b8> Claimed = false;
+			std::function<void()> Run;
+
+			// NOTE: Only ever runs the task once, whichever of the workers or the waiting thread gets to it first
+			void TryRun() { if (!Claimed.exchange(true)) Run(); }
+		};
+
+	public:
+		template <typename ResultType>
+		class Task
+		{
+			friend class ThreadPool;
+
+		public:
+			Task() = default;
+			Task(Task&& other) = default;
+			~Task() { SkipOrWait(); }
+
+			Task& operator=(Task&& other) { SkipOrWait(); entry = std::move(other.entry); future = std::move(other.future); return *this; }
+
+		public:
+			// NOTE: Blocks until the task has finished, running it on the calling thread if it hasn't been started yet
+			ResultType Get() { entry->TryRun(); return future.get(); }
+			b8 IsValid() const { return future.valid(); }
+
+		private:
+			// NOTE: Tasks usually reference the stack of whoever submitted them so one that is dropped without ever being waited on
+			//		 either never runs at all or is waited on here, much like a std::async future going out of scope
+			void SkipOrWait()
+			{
+				if (!future.valid() || !entry->Claimed.exchange(true))
+					return;
+				future.wait();
+			}
+
+		private:
+			std::shared_ptr<TaskEntry> entry;
+			std::future<ResultType> future;
+		};
+
+	public:
+		ThreadPool(size_t workerCount);
+		~ThreadPool();
+
+	public:
+		// NOTE: Sized to the number of hardware threads and started on first use
+		static ThreadPool& GetShared();
+
+		// NOTE: Without async the task is only queued on the calling thread and runs once it is waited on, same as std::launch::deferred
+		template <typename Func>
+		auto Submit(b8 async, Func func) -> Task<decltype(func())>
+		{
+			using ResultType = decltype(func());
+
+			auto packagedTask = std::make_shared<std::packaged_task<ResultType()>>(std::move(func));
+			Task<ResultType> task;
+			task.future = packagedTask->get_future();
+			task.entry = std::make_shared<TaskEntry>();
+			task.entry->Run = [packagedTask] { (*packagedTask)(); };
+
+			if (async)
+				Enqueue(task.entry);
+			return task;
+		}
+
+		size_t GetWorkerCount() const;
+
+	private:
+		void Enqueue(std::shared_ptr<TaskEntry> entry);
+		void WorkerThreadLoop();
+
+	private:
+		std::vector<std::thread> workerThreads;
+		std::deque<std::shared_ptr<TaskEntry>> pendingEntries;
+		b8 stopRequested = false;
+
+		std::mutex mutex;
+		std::condition_variable pendingCondition;
+	};
+}
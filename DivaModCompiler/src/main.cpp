@@ -8,8 +8,15 @@
 std::string ModsFolder = "./mods";
 std::string SourceFolder = "rom_src";
 
+// NOTE: Compressed textures are only cached between runs when a folder is set
+std::string TextureCacheFolder = "";
+uint64_t TextureCacheMaxByteSize = (2ull * 1024 * 1024 * 1024);
+
 int main()
 {
+	if (!TextureCacheFolder.empty())
+		Sprite::EnableTextureCache(TextureCacheFolder, TextureCacheMaxByteSize);
+
 	std::vector<std::string> modDirectories;
 	for (auto& modDirectory : std::filesystem::directory_iterator(ModsFolder))
 	{
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <json.hpp>
 #include <core_io.h>
 #include <diva_archive.h>
 #include <diva_db.h>
 #include <util_string.h>
+#include "comfy/mapped_file.h"
 #include "comfy/texture_util.h"
 #include "sprite.h"
 
@@ -13,6 +19,25 @@ const std::string BaseDataPath = ".";
 const std::vector<const char*> CumulativeSetNames = { "SPR_SEL_PVTMB" };
 uint32_t CurrentSpriteId = 85000;
 
+// NOTE: Shared across all sprite sets of all mods, unchanged textures are loaded from disk instead of being compressed again.
+//       Stays null unless enabled so that by default nothing besides the compiled output is written to disk
+static std::shared_ptr<Comfy::TextureCache> SharedTextureCache = nullptr;
+
+void Sprite::EnableTextureCache(const std::string& directory, uint64_t maxByteSize)
+{
+	SharedTextureCache = std::make_shared<Comfy::TextureCache>(directory, maxByteSize);
+}
+
+// NOTE: Sets whose decoded sprites alone would exceed this size are built with bounded memory usage, decoding the sprites of each texture only while it is composited
+const uint64_t SpriteDecodeMemoryBudgetByteSize = (4ull * 1024 * 1024 * 1024);
+
+static std::shared_ptr<Comfy::MemoryBudget> GetSpriteDecodeMemoryBudget()
+{
+	// NOTE: Shared across all sprite sets of all mods so that the limit holds no matter how many of them are being packed
+	static auto memoryBudget = std::make_shared<Comfy::MemoryBudget>(SpriteDecodeMemoryBudgetByteSize);
+	return memoryBudget;
+}
+
 static bool ParseSpriteInfo(std::string& rootPath, SpriteSetList& data, SpriteSetList& cumulativeData)
 {
 	// NOTE: Try to open and read all the data from `spr_info.json`
@@ -37,6 +62,12 @@ static bool ParseSpriteInfo(std::string& rootPath, SpriteSetList& data, SpriteSe
 			setInfo = &data.emplace_back();
 
 		setInfo->Name = srcSet["Name"];
+		setInfo->QualityTarget = srcSet.value("QualityTarget", 0.0f);
+		setInfo->CompressionQuality = srcSet.value("CompressionQuality", "Normal");
+		setInfo->HeaderChannelHints = srcSet.value("HeaderChannelHints", false);
+		setInfo->BoundedMemory = srcSet.value("BoundedMemory", false);
+		setInfo->PunchThroughAlpha = srcSet.value("PunchThroughAlpha", false);
+		setInfo->MergeDuplicateSprites = srcSet.value("MergeDuplicateSprites", false);
 		for (auto& srcSpr : srcSet["Sprites"])
 		{
 			auto& sprInfo = setInfo->Sprites.emplace_back();
@@ -62,32 +93,275 @@ static bool CheckSetInfoEligibleForPacking(Sprite::SpriteSetInfo& setInfo)
 	return true;
 }
 
+static Comfy::TextureCompressionQuality ParseCompressionQuality(const std::string& name)
+{
+	// NOTE: Draft for quick iteration and Max for release builds, anything else falls back to the default
+	if (name == "Draft")
+		return Comfy::TextureCompressionQuality::Draft;
+	if (name == "Max")
+		return Comfy::TextureCompressionQuality::Max;
+	return Comfy::TextureCompressionQuality::Normal;
+}
+
+static void ReportSpriteReadFailure(const Sprite::SpriteSetInfo& setInfo, size_t index)
+{
+	const auto& sprInfo = setInfo.Sprites[index];
+	printf("%s: Failed to read sprite %s from %s\n", setInfo.Name.c_str(), sprInfo.Name.c_str(), sprInfo.File.c_str());
+}
+
+// NOTE: Number of files past the one currently being decoded that are prefetched ahead of time
+const size_t SpriteImageReadAheadCount = 8;
+
+// NOTE: One worker per core keeps picking up the next sprite until all are done, the calling thread being one of them.
+//       These deliberately run on their own threads instead of the shared Comfy::ThreadPool. The packer tasks block on the decoded pixels
+//       and could otherwise occupy every pool worker while the decodes they are waiting for are still queued behind them
+template <typename Func>
+static void ForEachSpriteInParallel(size_t spriteCount, Func func)
+{
+	std::atomic<size_t> nextIndex = 0;
+	auto processSprites = [&]
+	{
+		for (size_t i = nextIndex++; i < spriteCount; i = nextIndex++)
+			func(i);
+	};
+
+	const size_t workerCount = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(spriteCount, 1));
+	std::vector<std::future<void>> workers;
+	workers.reserve(workerCount - 1);
+
+	for (size_t i = 1; i < workerCount; i++)
+		workers.push_back(std::async(std::launch::async, processSprites));
+
+	processSprites();
+	for (auto& worker : workers)
+		worker.get();
+}
+
+// NOTE: Only reads the file headers so the packer can already lay out the set while the pixels are still being decoded.
+//       The files are mapped in parallel and stay mapped for the decoders, so each one is only ever opened once and only the pages holding its header are read at this point
+static bool ReadSpriteImageInfos(const Sprite::SpriteSetInfo& setInfo, std::unique_ptr<Comfy::MappedFile[]>& outMappedFiles, std::vector<Comfy::ImageFileInfo>& outInfos)
+{
+	const size_t spriteCount = setInfo.Sprites.size();
+	outMappedFiles = std::make_unique<Comfy::MappedFile[]>(spriteCount);
+	outInfos.assign(spriteCount, {});
+
+	std::vector<uint8_t> readFailed(spriteCount, false);
+	ForEachSpriteInParallel(spriteCount, [&](size_t i)
+	{
+		auto& mappedFile = outMappedFiles[i];
+		if (!mappedFile.Open(setInfo.Sprites[i].File) || !Comfy::ReadImageFileInfo(mappedFile.GetData(), mappedFile.GetSize(), outInfos[i]))
+			readFailed[i] = true;
+	});
+
+	bool success = true;
+	for (size_t i = 0; i < spriteCount; i++)
+	{
+		if (readFailed[i])
+		{
+			ReportSpriteReadFailure(setInfo, i);
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+// NOTE: Abandons every promise that is still pending once it goes out of scope, which hands anyone waiting on it a broken promise error
+//       instead of letting them wait forever. Promises that have already been fulfilled are unaffected
+class ScopedPixelPromiseGuard
+{
+public:
+	explicit ScopedPixelPromiseGuard(std::vector<std::promise<const void*>>& promises) : promises(promises) {}
+
+	~ScopedPixelPromiseGuard()
+	{
+		for (auto& promise : promises)
+			std::promise<const void*> abandonedPromise = std::move(promise);
+	}
+
+private:
+	std::vector<std::promise<const void*>>& promises;
+};
+
+// NOTE: Decoding is mostly bound by PNG inflate so it's spread across one worker per core.
+//       The results are stored by manifest index so their order doesn't depend on which worker finished first.
+//       Each promise is fulfilled as soon as its sprite is decoded, sprites that fail to decode are handed out as fully transparent
+//       placeholders of their header size so the packer never has to wait on them indefinitely
+static bool ReadSpriteImages(const Sprite::SpriteSetInfo& setInfo, Comfy::MappedFile* mappedFiles, const std::vector<Comfy::ImageFileInfo>& imgInfos, std::vector<std::promise<const void*>>& pixelPromises,
+	std::vector<Comfy::DecodedImagePixels>& outPixelData, std::vector<std::unique_ptr<u8[]>>& outPlaceholderPixelData)
+{
+	// NOTE: Declared before the workers are started so that it only runs once all of them have been joined, even if decoding stops early because of an exception
+	const ScopedPixelPromiseGuard promiseGuard(pixelPromises);
+
+	const size_t spriteCount = setInfo.Sprites.size();
+	outPixelData.clear();
+	outPixelData.resize(spriteCount);
+	outPlaceholderPixelData.clear();
+	outPlaceholderPixelData.resize(spriteCount);
+
+	// NOTE: Each file is prefetched exactly once by whichever worker gets to it first, usually while it is still a few files ahead in the manifest,
+	//       so the disk reads overlap with decoding. It is unmapped right after being decoded
+	auto prefetchOnceFlags = std::make_unique<std::once_flag[]>(spriteCount);
+	auto prefetchFile = [&](size_t index)
+	{
+		std::call_once(prefetchOnceFlags[index], [&] { mappedFiles[index].Prefetch(); });
+	};
+
+	ForEachSpriteInParallel(spriteCount, [&](size_t i)
+	{
+		prefetchFile(i);
+		for (size_t aheadIndex = i + 1; aheadIndex < std::min(i + 1 + SpriteImageReadAheadCount, spriteCount); aheadIndex++)
+			prefetchFile(aheadIndex);
+
+		ivec2 decodedSize = {};
+		auto& mappedFile = mappedFiles[i];
+		if (mappedFile.IsOpen())
+			Comfy::DecodeImageFileData(mappedFile.GetData(), mappedFile.GetSize(), decodedSize, outPixelData[i]);
+		mappedFile.Close();
+
+		if (outPixelData[i] != nullptr && decodedSize != imgInfos[i].Size)
+			outPixelData[i].reset();
+
+		if (outPixelData[i] == nullptr)
+			outPlaceholderPixelData[i] = std::make_unique<u8[]>(static_cast<size_t>(imgInfos[i].Size.x) * imgInfos[i].Size.y * 4);
+
+		pixelPromises[i].set_value((outPixelData[i] != nullptr) ? static_cast<const void*>(outPixelData[i].get()) : outPlaceholderPixelData[i].get());
+	});
+
+	bool success = true;
+	for (size_t i = 0; i < spriteCount; i++)
+	{
+		if (outPixelData[i] == nullptr)
+		{
+			ReportSpriteReadFailure(setInfo, i);
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+// NOTE: Used by sets built with bounded memory usage, where each sprite is decoded again every time the packer needs its pixels.
+//       A failure is only reported the first time, the packer then treats the sprite as fully transparent
+static Comfy::DecodedImagePixels LoadSpriteImage(const Sprite::SpriteSetInfo& setInfo, size_t index, ivec2 expectedSize, std::atomic<bool>& inOutFailed)
+{
+	const auto& sprInfo = setInfo.Sprites[index];
+
+	ivec2 decodedSize = {};
+	Comfy::DecodedImagePixels pixelData;
+	Comfy::MappedFile mappedFile;
+	if (mappedFile.Open(sprInfo.File))
+		Comfy::DecodeImageFileData(mappedFile.GetData(), mappedFile.GetSize(), decodedSize, pixelData);
+
+	if (pixelData != nullptr && decodedSize != expectedSize)
+		pixelData.reset();
+
+	if (pixelData == nullptr && !inOutFailed.exchange(true))
+		ReportSpriteReadFailure(setInfo, index);
+
+	return pixelData;
+}
+
 static std::unique_ptr<Comfy::SprSet> PackSpriteSet(const Sprite::SpriteSetInfo& setInfo)
 {
 	Comfy::SprPacker packer;
-	std::vector<std::unique_ptr<u8[]>> imgPixelData;
+	std::unique_ptr<Comfy::MappedFile[]> imgMappedFiles;
+	std::vector<Comfy::ImageFileInfo> imgInfos;
+	std::vector<Comfy::DecodedImagePixels> imgPixelData;
+	std::vector<std::unique_ptr<u8[]>> imgPlaceholderPixelData;
 	std::vector<Comfy::SprMarkup> markups;
 
-	// NOTE: Disable YCbCr texture encoding
+	// NOTE: Disable YCbCr texture encoding unless the set opts into a PSNR target in decibels,
+	//		 in which case each texture is stored in the smallest format that still meets it
 	packer.Settings.AllowYCbCrTextures = false;
+	if (setInfo.QualityTarget > 0.0f)
+	{
+		packer.Settings.AllowYCbCrTextures = true;
+		packer.Settings.CompressionQualityTarget = setInfo.QualityTarget;
+	}
+	packer.Settings.CompressionQuality = ParseCompressionQuality(setInfo.CompressionQuality);
 
-	for (auto& sprInfo : setInfo.Sprites)
+	// NOTE: Opt-in only because it changes the format, and with it the layout, of every sprite with binary alpha
+	packer.Settings.AllowPunchThroughAlphaTextures = setInfo.PunchThroughAlpha;
+	packer.Settings.MergeDuplicateSprites = setInfo.MergeDuplicateSprites;
+	packer.Settings.CompressedTextureCache = SharedTextureCache;
+
+	if (!ReadSpriteImageInfos(setInfo, imgMappedFiles, imgInfos))
+		return nullptr;
+
+	uint64_t imgPixelByteSize = 0;
+	for (const auto& imgInfo : imgInfos)
+		imgPixelByteSize += static_cast<uint64_t>(imgInfo.Size.x) * imgInfo.Size.y * 4;
+
+	const bool boundedMemory = setInfo.BoundedMemory || (imgPixelByteSize > SpriteDecodeMemoryBudgetByteSize);
+	// NOTE: Bounded sets open each file again every time one of its sprites is loaded instead of keeping thousands of mappings around for the entire build
+	if (boundedMemory)
 	{
-		std::unique_ptr<u8[]> imgData;
-		ivec2 imgSize = { };
+		packer.Settings.DecodeMemoryBudget = GetSpriteDecodeMemoryBudget();
+		imgMappedFiles.reset();
+	}
+
+	std::vector<std::promise<const void*>> imgPixelPromises(boundedMemory ? 0 : setInfo.Sprites.size());
+	auto imgReadFailed = std::make_unique<std::atomic<bool>[]>(setInfo.Sprites.size());
 
-		Comfy::ReadImageFile(sprInfo.File, imgSize, imgData);
-		imgPixelData.push_back(std::move(imgData));
+	markups.reserve(setInfo.Sprites.size());
+	for (size_t i = 0; i < setInfo.Sprites.size(); i++)
+	{
+		const auto& sprInfo = setInfo.Sprites[i];
 
 		auto& markup = markups.emplace_back();
 		markup.Name = sprInfo.Name;
-		markup.RGBAPixels = imgPixelData.back().get();
-		markup.Size = imgSize;
+		markup.RGBAPixels = nullptr;
+		markup.Size = imgInfos[i].Size;
 		markup.ScreenMode = Comfy::ScreenMode::HDTV1080;
 		markup.Flags = Comfy::SprMarkupFlags_Compress;
+
+		// NOTE: Opt-in only because an RGBA source image is always treated as transparent, even if it could have been stored as DXT1
+		if (setInfo.HeaderChannelHints)
+		{
+			markup.Flags |= Comfy::SprMarkupFlags_HeaderChannelHints;
+			if (!imgInfos[i].HasAlpha)
+				markup.Flags |= Comfy::SprMarkupFlags_HeaderOpaque;
+			if (imgInfos[i].Grayscale)
+				markup.Flags |= Comfy::SprMarkupFlags_HeaderGrayscale;
+		}
+
+		if (boundedMemory)
+		{
+			markup.LoadRGBAPixels = [&setInfo, &imgReadFailed, i, expectedSize = imgInfos[i].Size]
+			{
+				return LoadSpriteImage(setInfo, i, expectedSize, imgReadFailed[i]);
+			};
+		}
+		else
+		{
+			markup.PendingRGBAPixels = imgPixelPromises[i].get_future().share();
+		}
+	}
+
+	// NOTE: The packer only waits on the pixels of each sprite once it actually needs them, so layout and composition overlap with decoding
+	std::future<bool> readImagesFuture;
+	if (!boundedMemory)
+	{
+		readImagesFuture = std::async(std::launch::async, [&]
+		{
+			return ReadSpriteImages(setInfo, imgMappedFiles.get(), imgInfos, imgPixelPromises, imgPixelData, imgPlaceholderPixelData);
+		});
 	}
 
-	return packer.Create(markups);
+	auto sprSet = packer.Create(markups);
+
+	bool readSuccess = boundedMemory ? true : readImagesFuture.get();
+	for (size_t i = 0; i < setInfo.Sprites.size(); i++)
+		readSuccess &= !imgReadFailed[i];
+
+	if (!readSuccess)
+		return nullptr;
+
+	if (packer.Statistics.DuplicateSprites > 0)
+		printf("%s: Merged %u duplicate sprites, saving %zu bytes\n", setInfo.Name.c_str(), packer.Statistics.DuplicateSprites, packer.Statistics.DuplicateSpriteBytes);
+
+	return sprSet;
 }
 
 static int32_t GetSpriteIndex(const Comfy::SprSet& sprSet, std::string_view name)
@@ -185,9 +459,12 @@ void Sprite::CompileSpriteSetsWithDB(std::string& outputPath, SpriteSetList& inf
 		if (!CheckSetInfoEligibleForPacking(srcSetInfo))
 			continue;
 
-		// NOTE: Create SpriteSet file
+		// NOTE: Create SpriteSet file.
+		//       Sprites that failed to be read have already been reported, skip the set just like the ineligible ones
 		auto sprSet = PackSpriteSet(srcSetInfo);
-		
+		if (sprSet == nullptr)
+			continue;
+
 		// NOTE: Add this SpriteSet to our mod's SpriteDatabase
 		Database::SpriteSetInfo& sprSetInfo = sprDatabase.SpriteSets.emplace_back();
 		sprSetInfo.Name = srcSetInfo.Name;
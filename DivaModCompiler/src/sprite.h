@@ -16,11 +16,20 @@ namespace Sprite
 	struct SpriteSetInfo
 	{
 		std::string Name;
+		float QualityTarget = 0.0f;
+		std::string CompressionQuality = "Normal";
+		bool HeaderChannelHints = false;
+		bool BoundedMemory = false;
+		bool PunchThroughAlpha = false;
+		bool MergeDuplicateSprites = false;
 		std::vector<SpriteInfo> Sprites;
 	};
 
 	using SpriteSetList = std::vector<Sprite::SpriteSetInfo>;
 
+	// NOTE: Caches compressed textures inside the given directory between runs, the least recently used ones are evicted once it grows beyond the given size
+	void EnableTextureCache(const std::string& directory, uint64_t maxByteSize);
+
 	void CompileSpriteSetsWithDB(std::string& outputPath, SpriteSetList& info);
 	bool CompileSpriteData(std::string& rootPath, std::string& outputPath, SpriteSetList& cumulativeSetsInfo);
 }
\ No newline at end of file
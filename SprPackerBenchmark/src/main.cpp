@@ -0,0 +1,253 @@
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <json.hpp>
+#include "comfy/texture_util.h"
+
+// NOTE: Synthetic sprite set used to measure the SprPacker in isolation from any file IO
+struct BenchmarkScenario
+{
+	std::string Name;
+	std::vector<ivec2> SpriteSizes;
+	b8 Transparent;
+};
+
+struct BenchmarkSprites
+{
+	std::vector<std::unique_ptr<u8[]>> PixelData;
+	std::vector<Comfy::SprMarkup> Markups;
+};
+
+static std::vector<BenchmarkScenario> CreateScenarios()
+{
+	std::mt19937 random(0x5EED);
+	const auto randomRange = [&random](i32 min, i32 max) { return std::uniform_int_distribution<i32>(min, max)(random); };
+
+	std::vector<BenchmarkScenario> scenarios;
+
+	auto& uniformThumbnails = scenarios.emplace_back();
+	uniformThumbnails.Name = "uniform_thumbnails";
+	uniformThumbnails.Transparent = false;
+	for (i32 i = 0; i < 256; i++)
+		uniformThumbnails.SpriteSizes.push_back(ivec2(128, 128));
+
+	auto& uiMixedSizes = scenarios.emplace_back();
+	uiMixedSizes.Name = "ui_mixed_sizes";
+	uiMixedSizes.Transparent = true;
+	for (i32 i = 0; i < 400; i++)
+	{
+		// NOTE: Mostly small buttons and icons with the occasional large panel
+		const i32 maxSide = (randomRange(0, 9) == 0) ? 768 : 128;
+		uiMixedSizes.SpriteSizes.push_back(ivec2(randomRange(8, maxSide), randomRange(8, maxSide)));
+	}
+
+	auto& hugeBackgrounds = scenarios.emplace_back();
+	hugeBackgrounds.Name = "huge_backgrounds";
+	hugeBackgrounds.Transparent = false;
+	for (i32 i = 0; i < 8; i++)
+		hugeBackgrounds.SpriteSizes.push_back((i % 2 == 0) ? ivec2(1920, 1080) : ivec2(1280, 720));
+
+	auto& tinyIcons = scenarios.emplace_back();
+	tinyIcons.Name = "tiny_icons";
+	tinyIcons.Transparent = true;
+	for (i32 i = 0; i < 10000; i++)
+		tinyIcons.SpriteSizes.push_back(ivec2(randomRange(4, 24), randomRange(4, 24)));
+
+	return scenarios;
+}
+
+static BenchmarkSprites CreateScenarioSprites(const BenchmarkScenario& scenario)
+{
+	std::mt19937 random(static_cast<u32>(scenario.SpriteSizes.size()));
+
+	BenchmarkSprites sprites;
+	sprites.PixelData.reserve(scenario.SpriteSizes.size());
+	sprites.Markups.reserve(scenario.SpriteSizes.size());
+
+	for (const auto& size : scenario.SpriteSizes)
+	{
+		// NOTE: Smooth gradients with a random base color so each sprite is unique but still compresses like real artwork
+		auto rgbaPixels = std::make_unique<u8[]>(size.x * size.y * 4);
+		const u32 baseColor = random();
+
+		for (i32 y = 0; y < size.y; y++)
+		{
+			for (i32 x = 0; x < size.x; x++)
+			{
+				u8* pixel = &rgbaPixels[(y * size.x + x) * 4];
+				pixel[0] = static_cast<u8>((baseColor >> 0) + (x * 255 / size.x));
+				pixel[1] = static_cast<u8>((baseColor >> 8) + (y * 255 / size.y));
+				pixel[2] = static_cast<u8>((baseColor >> 16) + ((x + y) * 127 / (size.x + size.y)));
+				pixel[3] = scenario.Transparent ? static_cast<u8>(Max(0, 255 - ((x * 2 - size.x) * (x * 2 - size.x) + (y * 2 - size.y) * (y * 2 - size.y)) * 255 / (size.x * size.y))) : 0xFF;
+			}
+		}
+
+		auto& markup = sprites.Markups.emplace_back();
+		markup.Name = scenario.Name + "_" + std::to_string(sprites.Markups.size() - 1);
+		markup.Size = size;
+		markup.RGBAPixels = rgbaPixels.get();
+		markup.ScreenMode = Comfy::ScreenMode::HDTV1080;
+		markup.Flags = Comfy::SprMarkupFlags_Compress;
+
+		sprites.PixelData.push_back(std::move(rgbaPixels));
+	}
+
+	return sprites;
+}
+
+static nlohmann::ordered_json RunBenchmark(const BenchmarkScenario& scenario, const BenchmarkSprites& sprites, Comfy::SprPackingStrategy strategy, bool allowYCbCr, Comfy::TextureCompressionQuality quality)
+{
+	Comfy::SprPacker packer;
+	packer.Settings.PackingStrategy = strategy;
+	packer.Settings.AllowYCbCrTextures = allowYCbCr;
+	packer.Settings.CompressionQuality = quality;
+
+	auto totalStopwatch = CPUStopwatch::StartNew();
+	const auto sprSet = packer.Create(sprites.Markups);
+	const auto totalTime = totalStopwatch.Stop();
+
+	u64 spritePixels = 0, texturePixels = 0, outputBytes = 0;
+	for (const auto& spr : sprSet->Sprites)
+		spritePixels += static_cast<u64>(spr.PixelRegion.z) * static_cast<u64>(spr.PixelRegion.w);
+
+	for (const auto& tex : sprSet->TexSet.Textures)
+	{
+		texturePixels += static_cast<u64>(tex->GetSize().x) * static_cast<u64>(tex->GetSize().y);
+		for (const auto& mipMaps : tex->MipMapsArray)
+			for (const auto& mipMap : mipMaps)
+				outputBytes += mipMap.DataSize;
+	}
+
+	constexpr const char* qualityNames[] = { "draft", "normal", "max" };
+
+	nlohmann::ordered_json result;
+	result["scenario"] = scenario.Name;
+	result["strategy"] = (strategy == Comfy::SprPackingStrategy::MaxRects) ? "max_rects" : "pixel_scan";
+	result["ycbcr"] = allowYCbCr;
+	result["quality"] = qualityNames[static_cast<u8>(quality)];
+	result["sprite_count"] = sprites.Markups.size();
+	result["texture_count"] = sprSet->TexSet.Textures.size();
+	result["atlas_occupancy"] = (texturePixels > 0) ? (static_cast<f64>(spritePixels) / static_cast<f64>(texturePixels)) : 0.0;
+	result["output_bytes"] = outputBytes;
+	result["total_ms"] = totalTime.TotalMilliseconds();
+	result["layout_ms"] = packer.Statistics.LayoutTime.TotalMilliseconds();
+	result["composite_ms"] = packer.Statistics.CompositeTime.TotalMilliseconds();
+	result["compress_ms"] = packer.Statistics.CompressTime.TotalMilliseconds();
+
+	printf("%-20s %-10s ycbcr=%d %-6s: %6.1f ms total (layout %.1f, composite %.1f, compress %.1f), %zu textures, %.1f%% occupancy\n",
+		scenario.Name.c_str(),
+		result["strategy"].get<std::string>().c_str(),
+		allowYCbCr,
+		qualityNames[static_cast<u8>(quality)],
+		totalTime.TotalMilliseconds(),
+		packer.Statistics.LayoutTime.TotalMilliseconds(),
+		packer.Statistics.CompositeTime.TotalMilliseconds(),
+		packer.Statistics.CompressTime.TotalMilliseconds(),
+		sprSet->TexSet.Textures.size(),
+		result["atlas_occupancy"].get<f64>() * 100.0);
+
+	return result;
+}
+
+static nlohmann::ordered_json RunConversionBenchmark(ivec2 size)
+{
+	const size_t pixelCount = static_cast<size_t>(size.x) * size.y;
+
+	std::mt19937 random(0xC0FFEE);
+	std::vector<u32> inputPixels(pixelCount);
+	for (auto& pixel : inputPixels)
+		pixel = random();
+
+	// NOTE: The random RGBA input doubles as arbitrary YA and CbCr input for the reverse conversion
+	const u8* inputYA = reinterpret_cast<const u8*>(inputPixels.data());
+	const u8* inputCbCr = inputYA + pixelCount * 2;
+	const size_t reversePixelCount = pixelCount / 2;
+
+	std::vector<u8> referenceYA, referenceCbCr;
+	std::vector<u32> referenceRGBA;
+
+	nlohmann::ordered_json results = nlohmann::ordered_json::array();
+	for (auto level = Comfy::SimdLevel::Scalar; level <= Comfy::GetSupportedSimdLevel(); level = static_cast<Comfy::SimdLevel>(static_cast<u8>(level) + 1))
+	{
+		std::vector<u8> outputYA(pixelCount * 2), outputCbCr(pixelCount * 2);
+		std::vector<u32> outputRGBA(reversePixelCount);
+
+		Comfy::SetMaxSimdLevel(level);
+
+		auto stopwatch = CPUStopwatch::StartNew();
+		Comfy::ConvertRGBAToYACbCrPixels(inputPixels.data(), outputYA.data(), outputCbCr.data(), pixelCount);
+		const auto toYACbCrTime = stopwatch.Restart();
+		Comfy::ConvertYACbCrToRGBAPixels(inputYA, inputCbCr, outputRGBA.data(), reversePixelCount);
+		const auto toRGBATime = stopwatch.Stop();
+
+		if (level == Comfy::SimdLevel::Scalar)
+		{
+			referenceYA = outputYA;
+			referenceCbCr = outputCbCr;
+			referenceRGBA = outputRGBA;
+		}
+
+		i32 maxDifference = 0;
+		for (size_t i = 0; i < pixelCount * 2; i++)
+			maxDifference = Max(maxDifference, Max(std::abs(outputYA[i] - referenceYA[i]), std::abs(outputCbCr[i] - referenceCbCr[i])));
+		for (size_t i = 0; i < reversePixelCount * 4; i++)
+			maxDifference = Max(maxDifference, std::abs(reinterpret_cast<const u8*>(outputRGBA.data())[i] - reinterpret_cast<const u8*>(referenceRGBA.data())[i]));
+
+		constexpr const char* levelNames[] = { "scalar", "sse41", "avx2" };
+
+		nlohmann::ordered_json result;
+		result["simd_level"] = levelNames[static_cast<u8>(level)];
+		result["width"] = size.x;
+		result["height"] = size.y;
+		result["rgba_to_yacbcr_ms"] = toYACbCrTime.TotalMilliseconds();
+		result["yacbcr_to_rgba_ms"] = toRGBATime.TotalMilliseconds();
+		result["max_difference_to_scalar"] = maxDifference;
+		results.push_back(result);
+
+		printf("%-20s %-10s: %6.1f ms rgba -> yacbcr, %6.1f ms yacbcr -> rgba, max difference %d\n",
+			"ycbcr_conversion",
+			levelNames[static_cast<u8>(level)],
+			toYACbCrTime.TotalMilliseconds(),
+			toRGBATime.TotalMilliseconds(),
+			maxDifference);
+	}
+
+	Comfy::SetMaxSimdLevel(Comfy::SimdLevel::Count);
+	return results;
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string outputPath = (argc > 1) ? argv[1] : "spr_packer_benchmark.json";
+
+	nlohmann::ordered_json results;
+	results["packing"] = nlohmann::ordered_json::array();
+	for (const auto& scenario : CreateScenarios())
+	{
+		const auto sprites = CreateScenarioSprites(scenario);
+
+		for (const auto strategy : { Comfy::SprPackingStrategy::PixelScan, Comfy::SprPackingStrategy::MaxRects })
+		{
+			for (const bool allowYCbCr : { false, true })
+				results["packing"].push_back(RunBenchmark(scenario, sprites, strategy, allowYCbCr, Comfy::TextureCompressionQuality::Normal));
+		}
+
+		// NOTE: The encoder quality tiers only apply to the DXT formats so there is no point in also enabling YCbCr textures for these
+		for (const auto quality : { Comfy::TextureCompressionQuality::Draft, Comfy::TextureCompressionQuality::Max })
+			results["packing"].push_back(RunBenchmark(scenario, sprites, Comfy::SprPackingStrategy::MaxRects, false, quality));
+	}
+
+	results["ycbcr_conversion"] = RunConversionBenchmark(ivec2(2048, 1024));
+
+	std::ofstream outputFile(outputPath);
+	if (!outputFile)
+	{
+		printf("Failed to open %s for writing\n", outputPath.c_str());
+		return 1;
+	}
+
+	outputFile << results.dump(1, '\t') << '\n';
+	return 0;
+}